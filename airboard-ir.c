@@ -53,6 +53,9 @@
  * with '-g', if the blue Fn key is held, the joystick sends scrolling
  * events rather than motion events.
  *
+ * with '-i', joystick motion is smoothed by interpolating between
+ * the keyboard's (rather sparse) mouse reports.
+ *
  * invocation:  as a critical system service, this program should be
  * invoked from inittab, or from /etc/event.d on systems running
  * upstart (ubuntu, possibly modern fedora).  a sample invocation line
@@ -63,6 +66,13 @@
  * service, provision is made for assigning elevated scheduling
  * priority to this program (-r).
  *
+ * internally, the tty is read by one thread, which hands the data to
+ * a decoder thread (keyboard and mouse) and a network thread (lircd
+ * and hotkeys) through lock-free queues.  a stalled network
+ * connection therefore can't delay keystrokes.  sending SIGUSR1
+ * reports the queue depths, and SIGUSR2 dumps the flight recorder
+ * (see flightrec.h).
+ *
  *
  **********
  *
@@ -106,13 +116,31 @@
 #include <sched.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <poll.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include <linux/input.h>
 #include <linux/uinput.h>
 
 #include <linux/input.h>
 
+#include "avrhost.h"
+#include "flightrec.h"
+#include "airboard.h"
+
+/* these arrived with linux 5.0 */
+#ifndef REL_WHEEL_HI_RES
+# define REL_WHEEL_HI_RES 0x0b
+# define REL_HWHEEL_HI_RES 0x0c
+#endif
+#define WHEEL_CLICK 120  /* high-resolution units per legacy click */
+
 char *me;
 
 void
@@ -122,7 +150,12 @@ usage(void)
         "usage: %s [options] -t <ttydev>\n"
         "  tty options:\n"
         "    '-H' for high speed tty (115200 instead of 38400).\n"
-        "    '-w <S>' to poll the creation of ttydev at S second intervals.\n"
+        "    '-B <rate>' to switch the device to 76800, 250000 or 500000 baud\n"
+        "        (it asks at 38400, so not with '-H').\n"
+        "    '-w <S>' to wait for ttydev's creation (polling every S seconds,\n"
+        "        if it can't be watched).\n"
+        "    ttydev may be 'usb:<serial>', to find a usb adapter by serial number.\n"
+        "    '-W <S>' to reopen ttydev if the device stalls for S seconds.\n"
         "  airboard options:\n"
         "    '-a' to include support for the airboard keyboard.\n"
         "    '-s <host>:<port>' to divert airboard multimedia keys to\n"
@@ -130,8 +163,11 @@ usage(void)
         "    '-m NN,NN,NN,NN' to specify mouse acceleration parameters.\n"
         "        All 4 levels must be specified.  Default is 1,5,10,25.\n"
         "    '-g' to enable grab scrolling (using blue 'Fn' key)\n"
+        "    '-i <hz>' to smooth mouse motion by interpolating at hz\n"
+        "        (e.g. 125) between the keyboard's mouse reports.\n"
         "  lircd options:\n"
         "    '-h <lircd_host>' to specify the lircd host for CIR decoding\n"
+        "        (or 'unix:<path>' for a local unix-domain socket).\n"
         "    '-p <lircd_port>] (defaults to 8765).\n"
         "    '-T' make a TCP connection for CIR rather than UDP (uncommon).\n"
         "  daemon options:\n"
@@ -140,9 +176,12 @@ usage(void)
         "    '-r' to run with elevated (sched_fifo) scheduling priority.\n"
         "    '-d' for debugging (repeate for more verbosity).\n"
         "    '-X' don't forward any IR commands or keystrokes (for debug).\n"
+        "    '-F <path>' names the flight recorder's dumps, which are written\n"
+        "        on SIGUSR2, phase errors, and bad keycodes.\n"
+        "        (default " FR_DIR "/%s-flight)\n"
         " (%s requires root privileges if -a or -r is used.)\n"
 	" This is airboard-ir version %s\n"
-        , me, me, VERSION);
+        , me, me, me, VERSION);
     exit(1);
 }
 
@@ -169,6 +208,7 @@ int airboard;
  */
 char *spec_host;
 int spec_port;
+dest_t spec_dest;
 
 /* mouse acceleration values.  should really be done by the
  * window system
@@ -178,97 +218,277 @@ int mouse_speeds[] = {0, 1, 5, 10, 25};
 /* special key (currently the blue "Fn" key) enables grab scrolling */
 int do_grabscroll;
 int scrolling;
-#define SCROLL_QUANTUM 15  /* "distance" before we emulate a scroll button */
-int cumul_x_scroll, cumul_y_scroll;
+#define SCROLL_QUANTUM 15  /* "distance" for one legacy scroll click */
+int cumul_x_scroll, cumul_y_scroll;  /* in high-resolution units */
+
+/* scroll velocity, in high-resolution wheel units (120 per click)
+ * per mouse report, for each joystick speed level.  filled in by
+ * scroll_accel_init() from the mouse speeds.
+ */
+int scroll_speeds[5];
 
-/* default port for reports to lircd */
-#define LIRCD_UDP_PORT 8765
+/* where consumer IR goes */
+char *lircdhost;
+int lircdport = LIRCD_UDP_PORT;
+int lircd_tcp;
+dest_t lircd_dest;
 
+/* is anyone draining the lircd and hotkey rings? */
+int net_thread_running;
 
-/* see the "keyboard protocol" and "mouse protocol" comment blocks
- * for descriptions of the actual binary reports.
+
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+static int uinp_fd = -1;
+
+/*
+ * logging.  syslog and stderr can both block (a slow syslogd, a
+ * stopped terminal), and report() and dbg() are called from the tty
+ * reader and the decoder, so messages aren't written directly.
+ * they're formatted into a preallocated ring instead, and a log
+ * thread, running niced, writes them out.  nothing on the input path
+ * ever waits for it:  if the ring is full, the message is counted
+ * and dropped.  until the log thread starts (threads don't survive
+ * daemon()), and in die(), messages are written directly.
+ *
+ * dbg() calls above DBG_MAX_LEVEL are compiled out altogether.
+ * building with -DDBG_MAX_LEVEL=1 takes the per-bit and per-word
+ * ones off the hot path, even as tests of 'debug'.
  */
-#define KEY_WORD_LEN 19
-#define MOUSE_WORD_LEN 30
+#ifndef DBG_MAX_LEVEL
+# define DBG_MAX_LEVEL 4
+#endif
 
-#define IR_UP_MASK 0x801
-#define IR_REPEAT 0x656d5
+#define LOGRING_SIZE 1024       // NB!  power of 2
+#define LOGRING_MASK (LOGRING_SIZE - 1)
+#define LOGRING_LINE 160
+#define LOGRING_NICE 10
+#define LOGRING_POLL_MS 1000    /* in case a wakeup is missed */
 
-#define IR_MOUSE_PREFIX 0x7e6
-#define IR_MOUSE_PREFIX_LEN 11
+/* what the entry was, for its formatting */
+#define MSG_REPORT 0
+#define MSG_DBG    1
+#define MSG_CHAR   2
 
+/*
+ * each slot's 'seq' says whose turn it is.  for the producer that
+ * claims position 'pos', the slot is free when seq is pos's lap
+ * (pos & ~LOGRING_MASK), and it sets seq to lap + 1 once the line is
+ * filled in.  the log thread hands the slot on to the next lap by
+ * setting it to lap + LOGRING_SIZE.  the all-zero ring starts out
+ * free, so it needs no initialization.
+ */
+typedef struct log_entry {
+    atomic_uint seq;
+    char kind;
+    char line[LOGRING_LINE];
+} log_entry_t;
+
+static log_entry_t log_ring[LOGRING_SIZE];
+static atomic_uint log_head;    /* claimed by producers */
+static atomic_uint log_tail;    /* advanced by the log thread */
+static atomic_ulong log_drops;
+static atomic_int log_sleeping;
+static int log_efd = -1;
+static volatile int log_running;
+
+/* work for the log thread, from signal handlers */
+volatile sig_atomic_t stats_due;
+void dump_stats(void);
+
+/* safe from a signal handler */
+static void
+log_wake(void)
+{
+    uint64_t one = 1;
+    ssize_t n;
+    int e = errno;
 
-typedef struct key_desc {
-    long ir_code;       /* IR code the airboard sends (9 bits) */
-    char *name;         /* for debug, and actually sent for special keys */
-    int event_code;     /* the event code for the uinput subsystem */
-    char type;          /* regular/mouse/special */
-} key_desc_t;
+    n = write(log_efd, &one, sizeof(one));
+    (void)n;    /* if it failed, LOGRING_POLL_MS catches up */
+    errno = e;
+}
 
-#define NUM_KEYS 128
+static void
+log_emit(int kind, const char *line)
+{
+    if (logtosyslog && debug <= 1) {
+        syslog(LOG_NOTICE, "%s", line);
+    } else if (kind == MSG_REPORT) {
+        fprintf(stderr, "%s: %s\n", me, line);
+    } else if (kind == MSG_DBG) {
+        fprintf(stderr, " %s\n", line);
+    } else {
+        fputs(line, stderr);
+    }
+}
 
-#define TYPE_MOUSE   1
-#define TYPE_SPECIAL 2
-#define TYPE_REPEAT  3
-#define TYPE_ALL_UP  4
-#define TYPE_GRAB    5
+static void
+log_put(int kind, const char *fmt, va_list ap)
+{
+    char buf[LOGRING_LINE];
+    unsigned int pos, seq, lap;
+    log_entry_t *e;
 
-extern key_desc_t keys[NUM_KEYS];  /* declared below */
+    if (!log_running) {
+        vsnprintf(buf, sizeof(buf), fmt, ap);
+        log_emit(kind, buf);
+        return;
+    }
 
-extern char *optarg;
-extern int optind, opterr, optopt;
+    pos = atomic_load_explicit(&log_head, memory_order_relaxed);
+    while (1) {
+        e = &log_ring[pos & LOGRING_MASK];
+        lap = pos & ~LOGRING_MASK;
+        seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (seq == lap) {
+            /* free -- try to claim it.  on failure, pos is updated */
+            if (atomic_compare_exchange_weak(&log_head, &pos, pos + 1))
+                break;
+        } else if ((int)(seq - lap) < 0) {
+            /* still holds last lap's line:  full */
+            atomic_fetch_add(&log_drops, 1);
+            return;
+        } else {
+            /* someone else got there first */
+            pos = atomic_load_explicit(&log_head, memory_order_relaxed);
+        }
+    }
 
-static int uinp_fd = -1;
+    vsnprintf(e->line, LOGRING_LINE, fmt, ap);
+    e->kind = kind;
+    atomic_store_explicit(&e->seq, lap + 1, memory_order_release);
+
+    if (atomic_load(&log_sleeping))
+        log_wake();
+}
 
 static void
-report(const char *fmt, ...)
+log_putf(int kind, const char *fmt, ...)
 {
     va_list ap;
 
     va_start(ap, fmt);
-    if (logtosyslog && debug <= 1) {
-        vsyslog(LOG_NOTICE, fmt, ap);
-    } else {
-        fprintf(stderr, "%s: ", me);
-        vfprintf(stderr, fmt, ap);
-        fputc('\n', stderr);
+    log_put(kind, fmt, ap);
+    va_end(ap);
+}
+
+/* is the next line ready to be written? */
+static int
+log_ready(void)
+{
+    unsigned int tail = atomic_load_explicit(&log_tail, memory_order_relaxed);
+
+    return atomic_load_explicit(&log_ring[tail & LOGRING_MASK].seq,
+            memory_order_acquire) == (tail & ~LOGRING_MASK) + 1;
+}
+
+/* the log thread:  writes out the ring as it fills */
+void *
+log_loop(void *arg)
+{
+    struct pollfd pfd;
+    unsigned long drops;
+    unsigned int tail;
+    uint64_t count;
+    log_entry_t *e;
+
+    /* on linux, this affects just this thread */
+    if (setpriority(PRIO_PROCESS, 0, LOGRING_NICE) < 0)
+        report("unable to lower log thread priority");
+
+    pfd.fd = log_efd;
+    pfd.events = POLLIN;
+
+    while (1) {
+
+        while (log_ready()) {
+            tail = atomic_load_explicit(&log_tail, memory_order_relaxed);
+            e = &log_ring[tail & LOGRING_MASK];
+            log_emit(e->kind, e->line);
+            atomic_store_explicit(&e->seq, (tail & ~LOGRING_MASK) +
+                    LOGRING_SIZE, memory_order_release);
+            atomic_store(&log_tail, tail + 1);
+        }
+
+        if (stats_due) {
+            stats_due = 0;
+            dump_stats();
+        }
+        flightrec_service();
+
+        drops = atomic_exchange(&log_drops, 0);
+        if (drops)
+            log_putf(MSG_REPORT, "log ring full, %lu messages lost", drops);
+
+        atomic_store(&log_sleeping, 1);
+        if (!log_ready() && poll(&pfd, 1, LOGRING_POLL_MS) > 0 &&
+                read(log_efd, &count, sizeof(count)) < 0)
+            report("log wakeup failed");
+        atomic_store(&log_sleeping, 0);
     }
+    return 0;
 }
 
-static void
-dbg(int level, const char *fmt, ...)
+void start_thread(void *(*fn)(void *), char *name, int realtime, int prio);
+
+void
+log_start(void)
 {
-    va_list ap;
+    log_efd = eventfd(0, EFD_CLOEXEC);
+    if (log_efd < 0)
+        die("eventfd for log ring");
+    start_thread(log_loop, "log", 0, 0);
+    log_running = 1;
+    flightrec_wake = log_wake;
+}
 
-    if (debug < level) return;
+void
+report(const char *fmt, ...)
+{
+    va_list ap;
 
     va_start(ap, fmt);
-    if (logtosyslog && debug <= 1) {
-        vsyslog(LOG_NOTICE, fmt, ap);
-    } else {
-        fputc(' ', stderr);
-        vfprintf(stderr, fmt, ap);
-        fputc('\n', stderr);
-    }
+    log_put(MSG_REPORT, fmt, ap);
+    va_end(ap);
 }
 
 static void
-dbgchar(int level, int c)
+dbg_log(const char *fmt, ...)
 {
-    if (debug < level) return;
+    va_list ap;
 
-    if (logtosyslog && debug <= 1) {
-        syslog(LOG_NOTICE, "%c", c);  // shouldn't happen 
-    } else {
-        fputc(c, stderr);
-    }
+    va_start(ap, fmt);
+    log_put(MSG_DBG, fmt, ap);
+    va_end(ap);
 }
 
+#define dbg(level, ...) \
+    do { \
+        if ((level) <= DBG_MAX_LEVEL && debug >= (level)) \
+            dbg_log(__VA_ARGS__); \
+    } while (0)
+
+#define dbgchar(level, c) \
+    do { \
+        if ((level) <= DBG_MAX_LEVEL && debug >= (level)) \
+            log_putf(MSG_CHAR, "%c", (c)); \
+    } while (0)
+
 void
 die(const char *fmt, ...)
 {
     va_list ap;
+    int e = errno;
+    int i;
+
+    /* give the log thread a moment to write out what's queued */
+    log_running = 0;
+    for (i = 0; i < 100 && log_ready(); i++)
+        usleep(1000);
 
+    errno = e;
     va_start(ap, fmt);
     if (logtosyslog && debug <= 1) {
         vsyslog(LOG_ERR, fmt, ap);
@@ -279,6 +499,7 @@ die(const char *fmt, ...)
         fprintf(stderr, " - %s", strerror(errno));
         fputc('\n', stderr);
     }
+    va_end(ap);
     exit(1);
 }
 
@@ -340,6 +561,8 @@ setup_uinput(void)
         !++e || ioctl(uinp_fd, UI_SET_RELBIT, REL_Y) < 0 ||
         !++e || ioctl(uinp_fd, UI_SET_RELBIT, REL_WHEEL) < 0 ||
         !++e || ioctl(uinp_fd, UI_SET_RELBIT, REL_HWHEEL) < 0 ||
+        !++e || ioctl(uinp_fd, UI_SET_RELBIT, REL_WHEEL_HI_RES) < 0 ||
+        !++e || ioctl(uinp_fd, UI_SET_RELBIT, REL_HWHEEL_HI_RES) < 0 ||
         !++e || write(uinp_fd, &uinp, sizeof(uinp)) < 0 ||  // device
         !++e || ioctl(uinp_fd, UI_DEV_CREATE) < 0) {
             report("uinput setup failed, step %d\n", e);
@@ -349,22 +572,89 @@ setup_uinput(void)
     return 0;
 }
 
+/*
+ * events are queued with input_event(), and written to uinput as
+ * a complete report, all with one timestamp and one write(), when
+ * input_sync() adds the terminating SYN_REPORT.
+ *
+ * the timestamp is when the IR actually arrived, not when we got
+ * around to decoding it:  input_usec is the CLOCK_MONOTONIC start
+ * time of the word the decoder is working on (see pending_flush()),
+ * or 0 for events we make up ourselves, which are stamped "now".
+ * stamps never go backwards.  the difference from "now" is kept as
+ * the input latency, for SIGUSR1.
+ *
+ * the kernel's uinput may ignore our stamps, and substitute the time
+ * of the write (evdev clients pick their clock with EVIOCSCLOCKID --
+ * libinput asks for CLOCK_MONOTONIC).  the latency figures hold
+ * either way.
+ */
+#define MAX_BATCH 32
+static struct input_event event_batch[MAX_BATCH];
+static int n_batched;
+
+unsigned long long input_usec;
+static unsigned long long last_input_usec;
+unsigned long latency_count;
+unsigned long long latency_total, latency_max;
+
+static unsigned long long
+monotonic_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
 void
-input_event(unsigned int type, unsigned int code, int value)
+input_sync(void)
 {
-    struct input_event event;
+    unsigned long long now = monotonic_usec(), t;
+    int i;
+
+    event_batch[n_batched].type = EV_SYN;
+    event_batch[n_batched].code = SYN_REPORT;
+    event_batch[n_batched].value = 0;
+    n_batched++;
+
+    t = (input_usec && input_usec < now) ? input_usec : now;
+    if (t < last_input_usec)
+        t = last_input_usec;
+    last_input_usec = t;
+
+    if (input_usec) {
+        latency_count++;
+        latency_total += now - t;
+        if (now - t > latency_max)
+            latency_max = now - t;
+    }
 
-    memset(&event, 0, sizeof(event));
-    gettimeofday(&event.time, NULL);
+    for (i = 0; i < n_batched; i++) {
+        event_batch[i].time.tv_sec = t / 1000000;
+        event_batch[i].time.tv_usec = t % 1000000;
+    }
 
-    event.type = type;
-    event.code = code;
-    event.value = value;
-    if (write(uinp_fd, &event, sizeof(event)) < 0) {
-        report("warning: input event failed, t/c/v 0x%x/0x%x/0x%x\n",
-            type, code, value);
+    if (write(uinp_fd, event_batch, n_batched * sizeof(event_batch[0])) < 0) {
+        report("warning: input report of %d events failed", n_batched);
     }
 
+    n_batched = 0;
+}
+
+void
+input_event(unsigned int type, unsigned int code, int value)
+{
+    struct input_event *event;
+
+    /* always leave room for the SYN_REPORT */
+    if (n_batched == MAX_BATCH - 1)
+        input_sync();
+
+    event = &event_batch[n_batched++];
+    event->type = type;
+    event->code = code;
+    event->value = value;
 }
 
 void
@@ -372,209 +662,406 @@ send_a_motion(int x, int y)
 {
     input_event(EV_REL, REL_X, x);
     input_event(EV_REL, REL_Y, y);
-    input_event(EV_SYN, SYN_REPORT, 0);
+    input_sync();
 }
 
+/*
+ * scroll by x,y high-resolution units.  clients that understand
+ * the high-resolution axes scroll smoothly.  the legacy wheel axes
+ * get a click each time the running total crosses WHEEL_CLICK.
+ */
 void
 send_a_scroll(int x, int y)
 {
-    if (x)  {
-        dbg(1, "scroll %s", y > 0 ? "left" : "right");
-        input_event(EV_REL, REL_HWHEEL, x > 0 ? -1 : 1);
+    int clicks;
+
+    cumul_x_scroll += x;
+    cumul_y_scroll += y;
+
+    if (x)
+        input_event(EV_REL, REL_HWHEEL_HI_RES, -x);
+    if (y)
+        input_event(EV_REL, REL_WHEEL_HI_RES, -y);
+
+    if ((clicks = cumul_x_scroll / WHEEL_CLICK)) {
+        dbg(1, "scroll %s", x > 0 ? "left" : "right");
+        input_event(EV_REL, REL_HWHEEL, -clicks);
+        cumul_x_scroll -= clicks * WHEEL_CLICK;
     }
-    if (y) {
+    if ((clicks = cumul_y_scroll / WHEEL_CLICK)) {
         dbg(1, "scroll %s", y > 0 ? "up" : "down");
-        input_event(EV_REL, REL_WHEEL, y > 0 ? -1 : 1);
+        input_event(EV_REL, REL_WHEEL, -clicks);
+        cumul_y_scroll -= clicks * WHEEL_CLICK;
     }
-    input_event(EV_SYN, SYN_REPORT, 0);
+    input_sync();
 }
 
 void
 send_a_key(int key_event_code, int down)
 {
     input_event(EV_KEY, key_event_code, !!down);
-    input_event(EV_SYN, SYN_REPORT, 0);
+    input_sync();
 }
 
 
-int socket_init(int tcp, char *host, int port)
+void
+sighandler(int sig)
 {
-    struct sockaddr_in sa[1];
-    struct hostent *hent;
-    int s;
-
-    hent = gethostbyname(host);
-    if (!hent) {
-        report("gethostbyname failed for %s", host);
-        return -1;
-    }
+    tty_restore();
+    deinit_uinput_device();
+    die("got signal %d", sig);
+}
 
-    if (tcp) {
-        if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-            die("tcp socket open");
-    } else {
-        if ((s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
-            die("udp socket open");
-    }
+/*
+ * pointer motion interpolation:
+ *
+ * mouse reports only arrive every 25ms or so (30 bits at 1200
+ * baud), so sending each one as a single jump makes for a steppy
+ * pointer.  with '-i <hz>', each report's motion is instead spread
+ * across the report interval in smaller steps, paced by a timerfd
+ * at the given rate.  the first step goes out immediately, so there's
+ * no added latency.  a report with no motion in it stops the
+ * interpolation at once, so the pointer never coasts past the point
+ * where the joystick was released.
+ */
+#define MOUSE_REPORT_USEC 25000
+
+int interp_hz;
+static int interp_fd = -1;
+static int interp_slices;       /* steps per mouse report */
+static int interp_left;         /* steps remaining for this report */
+static int interp_x, interp_y;  /* motion remaining for this report */
+
+void
+interp_arm(int on)
+{
+    struct itimerspec its;
 
-    memset((char *) sa, 0, sizeof(*sa));
-    sa->sin_family = AF_INET;
-    sa->sin_port = htons(port);
-    sa->sin_addr = *((struct in_addr *)hent->h_addr);
-       
-    if (connect(s, (struct sockaddr *)sa, sizeof(*sa)) < 0) {
-        report("connect failed to %s:%d", host, port);
-        close(s);
-        return -1;
+    memset(&its, 0, sizeof(its));
+    if (on) {
+        its.it_interval.tv_nsec = 1000000000 / interp_hz;
+        its.it_value = its.it_interval;
     }
+    if (timerfd_settime(interp_fd, 0, &its, NULL) < 0)
+        die("timerfd_settime");
+}
+
+void
+interp_init(void)
+{
+    interp_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (interp_fd < 0)
+        die("timerfd_create");
 
-    return s;
+    interp_slices = (long)interp_hz * MOUSE_REPORT_USEC / 1000000;
+    if (interp_slices < 1)
+        interp_slices = 1;
+
+    dbg(1, "interpolating motion in %d steps at %dHz",
+            interp_slices, interp_hz);
 }
 
-/* shared by tty_init()/tty_restore() */
-struct termios prev_tios;
-int tty_fd;
+static int
+div_away(int a, int n)
+{
+    return (a + (a > 0 ? n - 1 : a < 0 ? 1 - n : 0)) / n;
+}
 
 void
-tty_restore(void)
+interp_step(void)
 {
-    if (tty_fd >= 0)
-        tcsetattr(tty_fd, TCSADRAIN, &prev_tios);
+    int dx, dy;
+
+    if (!interp_left)
+        return;
+
+    /* divide what's left evenly among the remaining steps,
+     * rounding away from zero, so that slow motion goes out on the
+     * first step rather than the last */
+    dx = div_away(interp_x, interp_left);
+    dy = div_away(interp_y, interp_left);
+    interp_x -= dx;
+    interp_y -= dy;
+
+    if (--interp_left == 0)
+        interp_arm(0);
+
+    if (dx || dy)
+        send_a_motion(dx, dy);
 }
 
 void
-sighandler(int sig)
+interp_stop(void)
 {
-    tty_restore();
-    deinit_uinput_device();
-    die("got signal %d", sig);
+    if (interp_left)
+        interp_arm(0);
+    interp_left = interp_x = interp_y = 0;
 }
 
-int tty_init(char *term, int wait_term, int speed)
+void
+interp_motion(int x, int y)
 {
-    int s;
-    struct termios tios;
-    int flags;
-    long fflags;
+    if (!x && !y) {
+        dbg(2, "motion ended, dropping %d,%d", interp_x, interp_y);
+        interp_stop();
+        return;
+    }
 
-    int logged = 0;
+    /* fold any leftover from the previous report into this one */
+    interp_x += x;
+    interp_y += y;
+    if (!interp_left)
+        interp_arm(1);
+    interp_left = interp_slices;
 
-    while(1) {
-        tty_fd = open(term, O_RDWR|O_NDELAY);
-        if (tty_fd >= 0 || errno != ENOENT || !wait_term)
-            break;
+    interp_step();
+}
 
-        if (!logged)
-            report("waiting for tty creation");
+void
+interp_timer(void)
+{
+    uint64_t expirations;
 
-        logged = 1;
+    if (read(interp_fd, &expirations, sizeof(expirations)) > 0)
+        interp_step();
+}
 
-        sleep(wait_term);
-    }
+/*
+ * rings:
+ *
+ * words from the tty reader are handed to the workers through
+ * single-producer/single-consumer rings, so the reader never waits
+ * for a slow consumer -- if a ring fills, new words are dropped
+ * (and counted) rather than blocking.  a consumer that finds its
+ * ring empty sleeps on the ring's eventfd, after first setting
+ * 'sleeping', so the producer only needs to make a system call to
+ * wake it when it actually might be asleep.
+ */
+#define RING_SIZE 512  // NB!  power of 2
+#define RING_MASK (RING_SIZE - 1)
+
+typedef struct ring {
+    char *name;
+    unsigned short buf[RING_SIZE];
+    unsigned long long usec[RING_SIZE]; /* when each word started */
+    atomic_uint head;           /* advanced by the producer */
+    atomic_uint tail;           /* advanced by the consumer */
+    atomic_int sleeping;
+    int efd;
+    unsigned int highwater;     /* deepest the queue has been */
+    unsigned long drops;
+} ring_t;
+
+ring_t airboard_ring = { .name = "airboard" };
+ring_t lircd_ring = { .name = "lircd" };
+ring_t hotkey_ring = { .name = "hotkey" };
+
+framer_t framer;
 
-    if (logged)
-        report("found tty");
+void
+ring_init(ring_t *r)
+{
+    r->efd = eventfd(0, EFD_CLOEXEC);
+    if (r->efd < 0)
+        die("eventfd for %s ring", r->name);
+}
 
-    if (tty_fd < 0)
-        die("can't open tty '%s'", term);
+void
+ring_put(ring_t *r, unsigned short w, unsigned long long usec)
+{
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned int depth = head - atomic_load(&r->tail);
+    uint64_t one = 1;
 
-    if (!isatty(tty_fd))
-        die("%s is not a tty", term);
+    if (depth >= RING_SIZE) {
+        if (r->drops++ % 1000 == 0)
+            report("%s queue full, %lu words dropped", r->name, r->drops);
+        return;
+    }
 
-    fflags = fcntl(tty_fd, F_GETFL );
-    fcntl (tty_fd, F_SETFL, fflags & ~O_NDELAY );
+    /* report each new power-of-two depth */
+    if (++depth > r->highwater) {
+        r->highwater = depth;
+        if (depth >= 8 && (depth & (depth - 1)) == 0)
+            report("%s queue depth reached %u", r->name, depth);
+    }
 
-    s = tcgetattr(tty_fd, &prev_tios);
-    if (s < 0)
-        die("tcgetattr on %s", term);
+    r->buf[head & RING_MASK] = w;
+    r->usec[head & RING_MASK] = usec;
+    atomic_store(&r->head, head + 1);
 
-    /* set up restore hooks quickly */
-    atexit(tty_restore);
+    if (atomic_load(&r->sleeping)) {
+        if (write(r->efd, &one, sizeof(one)) < 0)
+            report("%s ring wakeup failed", r->name);
+    }
+}
 
-    tios = prev_tios;
+int
+ring_get(ring_t *r, unsigned short *wp, unsigned long long *usecp)
+{
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
 
-    tios.c_oflag = 0;   /* no output flags at all */
-    tios.c_lflag = 0;   /* no line flags at all */
+    if (tail == atomic_load(&r->head))
+        return 0;
 
-    tios.c_cflag &= ~PARENB;    /* disable parity, both in and out */
-    tios.c_cflag |= CSTOPB|CLOCAL|CS8|CREAD;   /* two stop bits on transmit */
-                                            /* no modem control, 8bit chars, */
-                                            /* receiver enabled, */
+    *wp = r->buf[tail & RING_MASK];
+    if (usecp)
+        *usecp = r->usec[tail & RING_MASK];
+    atomic_store(&r->tail, tail + 1);
+    return 1;
+}
 
-    tios.c_iflag = IGNBRK | IGNPAR;    /* ignore break, ignore parity errors */
+static int
+ring_empty(ring_t *r)
+{
+    return atomic_load(&r->tail) == atomic_load(&r->head);
+}
 
-    tios.c_cc[VMIN] = 2;
-    tios.c_cc[VTIME] = 0;
-    tios.c_cc[VSUSP]  = _POSIX_VDISABLE;
-    tios.c_cc[VSTART] = _POSIX_VDISABLE;
-    tios.c_cc[VSTOP]  = _POSIX_VDISABLE;
+/*
+ * sleep until something arrives on either ring (r2 may be null),
+ * or the extra fd (if any) is readable, or the timeout (if any)
+ * expires.  returns like select().
+ */
+int
+ring_wait(ring_t *r1, ring_t *r2, int extrafd, struct timeval *to)
+{
+    fd_set readfd;
+    uint64_t count;
+    int ret, nfds;
 
-    s = cfsetspeed (&tios, speed);
-    if (s < 0)
-        die("cfsetspeed on %s", term);
-    s = tcsetattr(tty_fd, TCSAFLUSH, &tios);
-    if (s < 0)
-        die("tcsetattr on %s", term);
+    atomic_store(&r1->sleeping, 1);
+    if (r2)
+        atomic_store(&r2->sleeping, 1);
 
-    /* make sure RTS and DTR lines are high, since device may be
-     * phantom-powered.  no termios/posix way to do this, that i
-     * know of.
-     */
-    if (ioctl(tty_fd, TIOCMGET, &flags) >= 0) {
-        flags &= ~TIOCM_RTS;
-        flags &= ~TIOCM_DTR;
-        ioctl(tty_fd, TIOCMSET, &flags);
+    if (!ring_empty(r1) || (r2 && !ring_empty(r2))) {
+        ret = 1;
+    } else {
+        FD_ZERO(&readfd);
+        FD_SET(r1->efd, &readfd);
+        nfds = r1->efd + 1;
+        if (r2) {
+            FD_SET(r2->efd, &readfd);
+            if (r2->efd >= nfds)
+                nfds = r2->efd + 1;
+        }
+        if (extrafd >= 0) {
+            FD_SET(extrafd, &readfd);
+            if (extrafd >= nfds)
+                nfds = extrafd + 1;
+        }
+
+        ret = select(nfds, &readfd, 0, 0, to);
+
+        if (ret > 0) {
+            if (FD_ISSET(r1->efd, &readfd))
+                if (read(r1->efd, &count, sizeof(count)) < 0)
+                    die("eventfd read");
+            if (r2 && FD_ISSET(r2->efd, &readfd))
+                if (read(r2->efd, &count, sizeof(count)) < 0)
+                    die("eventfd read");
+        }
     }
 
-    return tty_fd;
+    atomic_store(&r1->sleeping, 0);
+    if (r2)
+        atomic_store(&r2->sleeping, 0);
+
+    return ret;
+}
+
+void
+ring_stats(ring_t *r)
+{
+    report("%s queue: depth %u, max %u, dropped %lu", r->name,
+            atomic_load(&r->head) - atomic_load(&r->tail),
+            r->highwater, r->drops);
+}
+
+/* SIGUSR2 dumps the flight recorder, from the log thread */
+void
+flighthandler(int sig)
+{
+    flightrec_request("requested", 0);
+}
+
+/*
+ * SIGUSR1 dumps the queue metrics, and the tty error counts.  the
+ * handler only sets a flag, and wakes the log thread, which does the
+ * work -- report() and friends aren't safe in a signal handler.
+ */
+void
+statshandler(int sig)
+{
+    stats_due = 1;
+    if (log_efd >= 0)
+        log_wake();
 }
 
+void
+dump_stats(void)
+{
+    ring_stats(&airboard_ring);
+    ring_stats(&lircd_ring);
+    ring_stats(&hotkey_ring);
+    tty_stats();
+    framer_stats(&framer, "framer");
+    if (latency_count)
+        report("input latency: %lu reports, average %.1fms, worst %.1fms",
+                latency_count, latency_total / 1000.0 / latency_count,
+                latency_max / 1000.0);
+}
+
+/*
+ * fetch the next word for the airboard decoder.  returns 1, or -2
+ * if 'block' is clear and nothing arrives within 20ms.
+ */
 int
-timed_read(int from, unsigned char *buf, int n, int block)
+timed_read(ring_t *r, unsigned short *wp, int block)
 {
-    if (block) {
-        return read(from, buf, n);
-    } else {
-        int ret;
-        fd_set readfd;
-        struct timeval to;
+    int ret;
+    struct timeval to;
 
-        FD_ZERO(&readfd);
-        FD_SET(from, &readfd);
-        to.tv_sec = 0;
-        to.tv_usec = 20 * 1000;  // 20ms
-        ret = select(from+1, &readfd, 0, &readfd, &to);
+    to.tv_sec = 0;
+    to.tv_usec = 20 * 1000;  // 20ms
+
+    /* the interpolation timer is serviced while we wait.  linux's
+     * select() leaves the unexpired time in 'to', so the 20ms
+     * non-blocking timeout still holds across timer ticks.
+     */
+    while (!ring_get(r, wp, &input_usec)) {
+        ret = ring_wait(r, 0, interp_fd, block ? NULL : &to);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            die("ring_wait");
+        }
         if (ret == 0)
             return -2;  // timeout
-        return read(from, buf, n);
+
+        if (interp_fd >= 0) {
+            input_usec = 0;
+            interp_timer();
+        }
     }
+    return 1;
 }
 
 void send_hotkey(char *name)
 {
-    static int s = -1;
     static char keyname[25];
 
-    if (s < 0)
-        s = socket_init(0, spec_host, spec_port);
-
-    if (s < 0) {
-        report("failed to init hotkey socket");
-        return;
-    }
-
     strncpy(keyname, name, sizeof(keyname)-2);
     keyname[sizeof(keyname)-1] = '\0';
     strcat(keyname, "\n");
-    if (write(s, keyname, strlen(keyname)) < 0) {
-        close(s);
-        s = -1;
-    }
+    if (dest_send(&spec_dest, keyname, strlen(keyname)) <= 0)
+        report("failed to send hotkey %s", name);
 }
 
 void set_scrolling(void)
 {
     dbg(1, "scrolling");
+    if (interp_hz)
+        interp_stop();
     scrolling = 1;
 }
 
@@ -666,30 +1153,55 @@ key_desc_t *lookup_key(long ir_code)
 
 }
 
+/* the set of keys currently held down, one bit per keycode (the
+ * top 7 bits of the report, i.e. the index into keys[]).
+ */
+typedef unsigned long long keymap_t;
+#define KEYMAP_BITS (8 * sizeof(keymap_t))
+keymap_t keys_down[NUM_KEYS / KEYMAP_BITS];
+
+#define key_index(keyp)     ((keyp) - keys)
+#define key_word(keyp)      keys_down[key_index(keyp) / KEYMAP_BITS]
+#define key_bit(keyp)       (1ULL << (key_index(keyp) % KEYMAP_BITS))
+#define key_is_down(keyp)   (key_word(keyp) & key_bit(keyp))
+#define mark_down(keyp)     (key_word(keyp) |= key_bit(keyp))
+#define mark_up(keyp)       (key_word(keyp) &= ~key_bit(keyp))
+
 void emitkey(long ir_code)
 {
-#define N_KEYS_PRESSED 21  // all fingers + all toes + 1
-    static key_desc_t *key_pressed[N_KEYS_PRESSED];
     key_desc_t *keyp;
-    int i;
+    keymap_t down;
+    int i, b;
 
     dbg(1, " 0x%05lx", ir_code);
 
     keyp = lookup_key(ir_code); 
-    if (!keyp) return;
+    if (!keyp) {
+        flightrec_event(FR_BADCODE, 0, ir_code);
+        flightrec_request("bad keycode", 1);
+        return;
+    }
+    flightrec_event(FR_KEY, 0, ir_code);
 
     if (keyp->type == TYPE_ALL_UP) {
         dbg(1, "got all-up");
         if (0) dbg(1, "skipping");
         /* cancel all outstanding keypresses, for safety */
-        for (i = 0; i < N_KEYS_PRESSED; i++) {
-            if (key_pressed[i]) {
-                dbg(1, "forcing %d / %s up", i, key_pressed[i]->name);
+        for (i = 0; i < NUM_KEYS / KEYMAP_BITS; i++) {
+            down = keys_down[i];
+            while (down) {
+                b = __builtin_ctzll(down);
+                down &= down - 1;
+                keyp = &keys[i * KEYMAP_BITS + b];
+                dbg(1, "forcing %s up", keyp->name);
                 if (!noxmit)
-                    send_a_key(key_pressed[i]->event_code, 0);
-                key_pressed[i] = 0;
+                    input_event(EV_KEY, keyp->event_code, 0);
             }
+            keys_down[i] = 0;
         }
+        /* all of the releases go out as a single report */
+        if (!noxmit && n_batched)
+            input_sync();
 
         reset_scrolling();
 
@@ -701,60 +1213,49 @@ void emitkey(long ir_code)
         dbg(1, "%s pressed", keyp->name);
 
         /* check for already pressed */
-        for (i = 0; i < N_KEYS_PRESSED; i++) {
-            if (key_pressed[i] == keyp) {
-                dbg(1, "ignoring %s already pressed at %d", keyp->name, i);
-                return;
-            }
+        if (key_is_down(keyp)) {
+            dbg(1, "ignoring %s already pressed", keyp->name);
+            return;
         }
-        /* record what's pressed */
-        for (i = 0; i < N_KEYS_PRESSED; i++) {
-            if (!key_pressed[i]) {
-                if (do_grabscroll && keyp->type == TYPE_GRAB) {
-                    set_scrolling();
-                } else if (!noxmit) {
-                    if (spec_host && keyp->type == TYPE_SPECIAL)
-                        send_hotkey(keyp->name);
-                    else
-                        send_a_key(keyp->event_code, 1);
-                }
 
-                dbg(1, "marking %s pressed at %d", keyp->name, i);
-                key_pressed[i] = keyp;
-                break;
-            }
+        /* record what's pressed */
+        if (do_grabscroll && keyp->type == TYPE_GRAB) {
+            set_scrolling();
+        } else if (!noxmit) {
+            if (spec_host && keyp->type == TYPE_SPECIAL)
+                ring_put(&hotkey_ring, key_index(keyp), 0);
+            else
+                send_a_key(keyp->event_code, 1);
         }
 
-    } else if (keyp->ir_code == (ir_code ^ IR_UP_MASK)) {
+        dbg(1, "marking %s pressed", keyp->name);
+        mark_down(keyp);
 
-        int mark_released = 0;
+    } else if (keyp->ir_code == (ir_code ^ IR_UP_MASK)) {
 
         dbg(1, "%s released", keyp->name);
 
-
         /* keep track of what's been released */
-        for (i = 0; i < N_KEYS_PRESSED; i++) {
-            if (key_pressed[i] == keyp) {
-                if (do_grabscroll && keyp->type == TYPE_GRAB) {
-                    reset_scrolling();
-                } else if (!noxmit) {
-                    if (spec_host && keyp->type == TYPE_SPECIAL)
-                        ;
-                    else
-                        send_a_key(keyp->event_code, 0);
-                }
-                dbg(1, "marking %s released at %d", keyp->name, i);
-                mark_released = 1;
-                key_pressed[i] = 0;
-                break;
-            }
-        }
-        if (!mark_released) {
+        if (!key_is_down(keyp)) {
             dbg(1, "no matching press for %s release, ignoring", keyp->name);
+            return;
+        }
+
+        if (do_grabscroll && keyp->type == TYPE_GRAB) {
+            reset_scrolling();
+        } else if (!noxmit) {
+            if (spec_host && keyp->type == TYPE_SPECIAL)
+                ;
+            else
+                send_a_key(keyp->event_code, 0);
         }
+        dbg(1, "marking %s released", keyp->name);
+        mark_up(keyp);
 
     } else {
         dbg(1, "%s: key lookup error: 0x%lx", me, ir_code);
+        flightrec_event(FR_BADCODE, 0, ir_code);
+        flightrec_request("key lookup error", 1);
     }
 
 }
@@ -796,10 +1297,30 @@ void emitkey(long ir_code)
  *
  */
 
+/*
+ * precompute the scroll velocity for each speed level.  the scale
+ * is one wheel click per SCROLL_QUANTUM of pointer motion, as the
+ * old click-at-a-time scrolling had, and like it, we never go past
+ * one click per report.  (the old code also lost the remainder at
+ * each click, so the slower levels come out a little faster now.)
+ */
+void
+scroll_accel_init(void)
+{
+    int n;
+
+    for (n = 0; n < 5; n++) {
+        scroll_speeds[n] = mouse_speeds[n] * WHEEL_CLICK / SCROLL_QUANTUM;
+        if (scroll_speeds[n] > WHEEL_CLICK)
+            scroll_speeds[n] = WHEEL_CLICK;
+    }
+}
+
+/* returns the speed level (0 to 4), negated for up or left */
 int
-motion_fixup(int raw, int *lastspeedp)
+motion_level(int raw)
 {
-    int mdir, n, goal, last;
+    int mdir, n;
 
     mdir = ((raw & 7) == 7) ? -1 : 1;
     raw >>= 3;
@@ -816,6 +1337,18 @@ motion_fixup(int raw, int *lastspeedp)
         n = 1;
     }
 
+    return n * mdir;
+}
+
+int
+motion_fixup(int raw, int *lastspeedp)
+{
+    int mdir, n, goal, last;
+
+    n = motion_level(raw);
+    mdir = (n < 0) ? -1 : 1;
+    n = abs(n);
+
     /* map the reported levels to better values */
     goal = mouse_speeds[n];
 
@@ -823,7 +1356,7 @@ motion_fixup(int raw, int *lastspeedp)
      * for each mouse packet received.
      */
     last = *lastspeedp;
-    dbg(2, "r 0x%x, n %d, g %d, last %d", raw, n, goal, last);
+    dbg(2, "r 0x%x, n %d, g %d, last %d", raw >> 3, n, goal, last);
     if (goal == 0) last = 0;
     else if (last > goal * 2)   last -= 2;
     else if (last > goal)       last -= 1;
@@ -851,237 +1384,427 @@ void emitmouse(long mousecode, int *last_y_motion)
     dbg(1, " mouse x,y 0x%02x,0x%02x %2d,%2d", x,y, nx,ny);
 
     if (scrolling) {
-        dbg(2, "would scroll");
+        /* scrolling isn't smoothed like the pointer is -- the
+         * speed level maps straight to a scroll velocity.
+         */
+        int lx = motion_level(x);
+        int ly = motion_level(y);
+        int sx = (lx < 0) ? -scroll_speeds[-lx] : scroll_speeds[lx];
+        int sy = (ly < 0) ? -scroll_speeds[-ly] : scroll_speeds[ly];
 
-        cumul_x_scroll += nx;
-        if (abs(cumul_x_scroll) > SCROLL_QUANTUM) {
-                send_a_scroll(cumul_x_scroll, 0);
-                cumul_x_scroll = 0;
-        }
-        
-        cumul_y_scroll += ny;
-        if (abs(cumul_y_scroll) > SCROLL_QUANTUM) {
-                send_a_scroll(0, cumul_y_scroll);
-                cumul_y_scroll = 0;
-        }
+        dbg(2, "scroll by %d,%d", sx, sy);
+        if (!noxmit && (sx || sy))
+            send_a_scroll(sx, sy);
 
     } else if (!noxmit) {
+        if (interp_hz)
+            interp_motion(nx, ny);
+        else
             send_a_motion(nx, ny);
     }
 
     *last_y_motion = ny;
 }
 
+/*
+ *  bit clock recovery:
+ *
+ *  the airboard is nominally a 1200 baud transmitter, but cheap
+ *  keyboards drift, and so does the RC oscillator in the avrlirc
+ *  that timestamps the runs.  converting runs to bit counts with a
+ *  fixed bit time makes long runs come out a bit too long or short,
+ *  which garbles the report.  so we track the actual bit period.
+ *
+ *  the IR receiver stretches marks and shrinks spaces by about the
+ *  same amount, so a single run is a biased measure of the bit time.
+ *  instead we pair each run with the one before it (always of the
+ *  opposite polarity), and the sum of the two is unbiased.  the
+ *  estimate is then nudged toward that measurement by a fraction
+ *  (1/BITCLOCK_GAIN) of the error -- a first-order phase-locked
+ *  loop.  runs that don't round cleanly to a bit count, or that are
+ *  too long to be trusted (gaps, trailing stop bits), are skipped.
+ *
+ *  all times are in thousandths of a 1/16384 second tick.
+ */
+#define BITTIME 13653   /*  1200 baud:  1/1200 * 16384 * 1000 */
+#define BITCLOCK_MAXDRIFT (BITTIME / 10)  /* track at most +/- 10% */
+#define BITCLOCK_GAIN 16
+#define BITCLOCK_MAXBITS 8      /* longest run used for tracking */
+
+long bittime = BITTIME;         /* current estimate of the bit period */
+static long bitclock_prevtime;  /* previous in-word run, for pairing */
+static int bitclock_prevbits;
+static int bitclock_reported;   /* drift last reported, in 0.1% units */
+
+int
+bitclock_bits(long time)
+{
+    return ((1000 * time) + bittime/2) / bittime;
+}
+
+void
+bitclock_reset(void)
+{
+    bitclock_prevtime = 0;
+    bitclock_prevbits = 0;
+}
 
 void
-data_loop(int from, int tcp, char *lircdhost, int lircdport)
+bitclock_track(long time, int bits)
+{
+    long resid, pairtime, est;
+    int pairbits, drift;
+
+    if (bits <= 0 || bits > BITCLOCK_MAXBITS) {
+        bitclock_reset();
+        return;
+    }
+
+    /* don't learn from runs that land near a half-bit boundary --
+     * that's where we'd be most likely to have miscounted.
+     */
+    resid = 1000 * time - bits * bittime;
+    if (labs(resid) > bittime / 3) {
+        bitclock_reset();
+        return;
+    }
+
+    if (bitclock_prevbits) {
+        pairtime = 1000 * (time + bitclock_prevtime);
+        pairbits = bits + bitclock_prevbits;
+        est = pairtime / pairbits;
+
+        bittime += (est - bittime) / BITCLOCK_GAIN;
+        if (bittime > BITTIME + BITCLOCK_MAXDRIFT)
+            bittime = BITTIME + BITCLOCK_MAXDRIFT;
+        else if (bittime < BITTIME - BITCLOCK_MAXDRIFT)
+            bittime = BITTIME - BITCLOCK_MAXDRIFT;
+
+        dbg(3, "bitclock: pair %ld/%d, est %ld, now %ld",
+                pairtime, pairbits, est, bittime);
+
+        drift = (bittime - BITTIME) * 1000 / BITTIME;
+        if (abs(drift - bitclock_reported) >= 5) {
+            report("bit clock drift now %c%d.%d%% (bit time %ld.%03ld ticks)",
+                    drift < 0 ? '-' : '+', abs(drift) / 10, abs(drift) % 10,
+                    bittime / 1000, bittime % 1000);
+            bitclock_reported = drift;
+        }
+    }
+
+    bitclock_prevtime = time;
+    bitclock_prevbits = bits;
+}
+
+
+/*
+ * the tty reader.  this runs in the main thread, at the highest
+ * priority if '-r' is given, and does nothing but frame the words
+ * and hand them off to the rings.  it returns when the tty goes
+ * away, or gets hopelessly out of phase.
+ */
+
+/*
+ * the words from one tty read are held until it's all been framed,
+ * so that each can be given the time it actually started:  the last
+ * one ended at about the time of the read, and we work backward from
+ * there through the durations.  (the serial and usb delays are small,
+ * and constant enough not to matter for inter-event timing.)
+ */
+#define PENDING_WORDS (FRAMER_BUFSIZE / 2 + FRAMER_WINDOW)
+static unsigned short pending[PENDING_WORDS];
+static unsigned long long pending_usec[PENDING_WORDS];
+static int n_pending;
+
+void
+pending_flush(void)
+{
+    unsigned long long t = framer.read_usec;
+    int i;
+
+    for (i = n_pending - 1; i >= 0; i--) {
+        t -= 1000000ULL * (pending[i] & 0x7fff) / STAMP_HZ;
+        pending_usec[i] = t;
+    }
+
+    for (i = 0; i < n_pending; i++) {
+        if (net_thread_running && lircdhost)
+            ring_put(&lircd_ring, pending[i], 0);
+
+        if (airboard)
+            ring_put(&airboard_ring, pending[i], pending_usec[i]);
+    }
+    n_pending = 0;
+}
+
+void
+frame_word(void *arg, unsigned short pulse)
+{
+    dbg(4, "%s: %s 0x%04x (%d) (%ldus)\n", me,
+            (pulse & 0x8000) ? "pulse" : "space",
+            pulse, pulse & 0x7fff, 1000000L * (pulse & 0x7fff) / 16384);
+
+    if (n_pending == PENDING_WORDS)
+        pending_flush();
+    pending[n_pending++] = pulse;
+}
+
+void
+data_loop(int from)
 {
-    unsigned char b[2];
     int n;
-    int prevhilo = -1;
-    int pulse;
-    long time = 0;
-    int bits = 0, hilo = 0, totbits = 0;
-    long bitaccum = 0;
-    int in_gap = 1;
-    int wordlen = KEY_WORD_LEN;
-    int block = 1;
-    int last_y_motion;
-    int phase_err_count = 0;
-    static int to = -1;
 
     setbuf(stdout, NULL);  // for timely debug messages
 
+    framer_init(&framer, frame_word, 0, 0);
+
     while (1) {
 
-        /* leave extra space in buf for extra bytes we may read below */
-        if ((n = timed_read(from, b, 2, block)) == -1)
-            die("timed_read");
+        n = framer_read(&framer, from);
+        pending_flush();
+        if (n == FRAMER_ERR) {
+            if (errno == EINTR)
+                continue;
+            die("read");
+        }
 
         /* in my experience, this results from a USB serial
          * device being unplugged */
-        if (n == 0)
+        if (n == FRAMER_EOF)
+            return;
+
+        /* reopening wouldn't help, so start over right here */
+        if (n == FRAMER_LOST) {
+            report("too many phase corrections, starting over");
+            framer_reset(&framer);
+            continue;
+        }
+
+        if (n == FRAMER_STALL) {
+            report("device stalled, re-opening tty");
             return;
+        }
+    }
+}
+
+/*
+ * the network worker:  forwards words to lircd, and sends hotkey
+ * names.  a stalled or slow connection only backs up (and
+ * eventually overflows) its own rings.
+ */
+void *
+net_loop(void *arg)
+{
+    unsigned short w;
+    unsigned char b[2];
+
+    while (1) {
 
-        if (n == 1) { /* short read -- force it even */
-            if (timed_read(from, &b[1], 1, 1) == -1)
-                die("timed_read");
-            n++;
+        while (ring_get(&lircd_ring, &w, 0)) {
+            b[0] = w & 0xff;
+            b[1] = w >> 8;
+            /* dest_send() reconnects later -- the keyboard and
+             * mouse carry on regardless */
+            if (dest_send(&lircd_dest, b, 2) < 0 && errno != ECONNREFUSED)
+                report("lircd write failed (%s), reconnecting",
+                        strerror(errno));
         }
 
+        while (ring_get(&hotkey_ring, &w, 0))
+            send_hotkey(keys[w].name);
+
+        ring_wait(&lircd_ring, &hotkey_ring, -1, 0);
+    }
+    return 0;
+}
+
+/*
+ * the airboard decoder:  turns runs into bits, and bits into key
+ * and mouse reports for uinput.
+ */
+void *
+airboard_loop(void *arg)
+{
+    unsigned short pulse;
+    int n;
+    long time = 0;
+    int bits = 0, hilo = 0, totbits = 0;
+    long bitaccum = 0;
+    int in_gap = 1;
+    int wordlen = KEY_WORD_LEN;
+    int block = 1;
+    int last_y_motion = 0;
+
+    while (1) {
+
+        n = timed_read(&airboard_ring, &pulse, block);
+
         block = 1;
 
         if (n > 0) {
-            pulse = (b[1] << 8) + b[0];
             hilo = pulse & 0x8000;
             time = pulse & 0x7fff;
-
-            dbg(4, "%s: %s 0x%04x (%ld) (%ldus)\n", me,
-                    hilo ? "pulse" : "space",
-                    pulse, time, 1000000 * time / 16384);
-
-            if (hilo == prevhilo) {
-                /*
-                 * if we somehow start our reads "halfway" through one
-                 * of the 16 bit data words, we'll forever be
-                 * out-of-sync.  we try to correct this by noticing
-                 * two things:  a) if the data contains two zero bytes
-                 * in succession, then they're definitely a pair
-                 * (since this is the out-of-band data prefix), and b)
-                 * the 16 bit values that we read should have
-                 * alternating high bits:  0x8000, 0x0000, 0x8000,
-                 * etc.
-                 */
-                if (phase_err_count++ > 10) {
-                    report("too many phase corrections, re-opening tty");
-                    return;
-                }
-                report("phase correction");
-                b[0] = b[1];
-                if (timed_read(from, &b[1], 1, 1) <= 0)
-                    die("timed_read");
-                hilo = (b[1] & 0x80);
-            }
-            prevhilo = hilo;
         }
 
-        /* send lircd data to lircdhost */
-        if (!noxmit && lircdhost)  {
-            if (to < 0)
-                to = socket_init(tcp, lircdhost, lircdport);
-            if (to >= 0) {
-                if (write(to, b, 2) < 0) {
-                    if (errno != ECONNREFUSED)
-                        die("write");
-                    close(to);
-                    to = -1;
-                }
+        if (n > 0) {
+            // report("h:%d t:%d ", hilo, time);
+            bits = bitclock_bits(time);
+            if (in_gap && hilo) { // skip marking during gap
+                // while (bits--)
+                dbgchar(2, 'S');
+                bitclock_reset();
+                continue;
+            } else if (in_gap && !hilo)  {
+                if (bits > 0) bits--;  // skip the start bit
+                dbgchar(2,'\t');
+                dbgchar(2,'s');
+                totbits = 0;
             }
+            in_gap = 0;
+            bitclock_track(time, bits);
+        } else {
+            // timeout -- fill in with 1's
+            bits = wordlen - totbits;
+            hilo = 1;
+            in_gap = 1;
+            bitclock_reset();
+            dbgchar(2,'f');
         }
 
-        if (airboard) {
-            if (n > 0) {
-#define BITTIME 13653   /*  1200 baud:  1/1200 * 16384 * 1000 */
-                // report("h:%d t:%d ", hilo, time);
-                bits = ((1000 * time) + BITTIME/2) / BITTIME;
-                if (in_gap && hilo) { // skip marking during gap
-                    // while (bits--)
-                    dbgchar(2, 'S');
-                    continue;
-                } else if (in_gap && !hilo)  {
-                    if (bits > 0) bits--;  // skip the start bit
-                    dbgchar(2,'\t');
-                    dbgchar(2,'s');
-                    totbits = 0;
-                }
-                in_gap = 0;
-            } else {
-                // timeout -- fill in with 1's
+        if (hilo && bits > 12) {
+            if (totbits > 2) {
                 bits = wordlen - totbits;
-                hilo = 1;
-                in_gap = 1;
-                dbgchar(2,'f');
+                //report(".0x%05llx", bitaccum);
+            } else if (totbits) {
+                bitaccum = 0;
+                totbits = 0;
+                continue;
+            } else {
+                continue;
             }
+        }
 
-            if (hilo && bits > 12) {
-                if (totbits > 2) {
-                    bits = wordlen - totbits;
-                    //report(".0x%05llx", bitaccum);
-                } else if (totbits) {
-                    bitaccum = 0;
-                    totbits = 0;
-                    continue;
-                } else {
-                    continue;
-                }
+        while (bits--) {
+            totbits++;
+            dbgchar(2, hilo ? '1':'0');
+            bitaccum = (bitaccum << 1) | (hilo ? 1 : 0);
+            if (totbits == IR_MOUSE_PREFIX_LEN) {
+                if (bitaccum == IR_MOUSE_PREFIX)
+                    wordlen = MOUSE_WORD_LEN;
+                else
+                    wordlen = KEY_WORD_LEN;
             }
-
-            while (bits--) {
-                totbits++;
-                dbgchar(2, hilo ? '1':'0');
-                bitaccum = (bitaccum << 1) | (hilo ? 1 : 0);
-                if (totbits == IR_MOUSE_PREFIX_LEN) {
-                    if (bitaccum == IR_MOUSE_PREFIX)
-                        wordlen = MOUSE_WORD_LEN;
-                    else
-                        wordlen = KEY_WORD_LEN;
-                }
-                // report(" 0x%llx", bitaccum);
-                if (totbits == wordlen) {
-                    if (wordlen == MOUSE_WORD_LEN)
-                        emitmouse(bitaccum, &last_y_motion);
-                    else
-                        emitkey(bitaccum);
-                    bitaccum = 0;
-                    totbits = 0;
+            // report(" 0x%llx", bitaccum);
+            if (totbits == wordlen) {
+                if (wordlen == MOUSE_WORD_LEN)
+                    emitmouse(bitaccum, &last_y_motion);
+                else
+                    emitkey(bitaccum);
+                bitaccum = 0;
+                totbits = 0;
+                in_gap = 1;
+                if (hilo && bits) {
+                    // report("t%d-", bits);
+                    bits = 0;
                     in_gap = 1;
-                    if (hilo && bits) {
-                        // report("t%d-", bits);
-                        bits = 0;
-                        in_gap = 1;
-                    }
                 }
             }
+        }
 
-            if (!hilo) { /* we're looking for 1's next */
-                /* because we get bit data in pairs of ones/zeros,
-                 * and because the "resting" state of the transmission
-                 * is ones (and the stop-bit of the "word" is a one),
-                 * we won't get informed of trailing ones in our word
-                 * until the _next_ word comes along.
+        if (!hilo) { /* we're looking for 1's next */
+            /* because we get bit data in pairs of ones/zeros,
+             * and because the "resting" state of the transmission
+             * is ones (and the stop-bit of the "word" is a one),
+             * we won't get informed of trailing ones in our word
+             * until the _next_ word comes along.
+             */
+            if (wordlen == MOUSE_WORD_LEN) {
+                /* we may be waiting for the end of a mouse
+                 * packet with trailing 1's.  since we don't know
+                 * what the trailing data might be, we force
+                 * a timeout on the next read.
+                 * we know from experiment that this can't happen
+                 * unless we're travelling vertically upward, and
+                 * we're within 8 bits of the end of the 30.  breaking
+                 * from the read early can have bad effects otherwise,
+                 * so we want to minimize doing it.
                  */
-                if (wordlen == MOUSE_WORD_LEN) {
-                    /* we may be waiting for the end of a mouse
-                     * packet with trailing 1's.  since we don't know
-                     * what the trailing data might be, we force
-                     * a timeout on the next read.
-                     * we know from experiment that this can't happen
-                     * unless we're travelling vertically upward, and
-                     * we're within 8 bits of the end of the 30.  breaking
-                     * from the read early can have bad effects otherwise,
-                     * so we want to minimize doing it.
-                     */
-                    if (totbits >= 22 && last_y_motion  < 0)
-                        block = 0;
-                } else {
-                    /* if we're waiting for a keycode, we simply do
-                     * our match on what we have so far, filling in
-                     * the missing ones ourself.
-                     */
-                    if (totbits >= 11) {
-                        static int lowbits[] = { 0,
-                            0x1, 0x3, 0x7, 0xf, 0x1f, 0x3f, 0x7f, 0xff
-                        };
-                        int needbits = wordlen - totbits;
-                        int have = bitaccum << needbits | lowbits[needbits];
-                        key_desc_t *keyp = lookup_key(have); 
-                        if (keyp) {
-                            if (keyp->ir_code == have ||
-                                (keyp->ir_code ^ IR_UP_MASK) == have) {
-                                dbgchar(2,'e');
-                                emitkey(have);
-                                bitaccum = 0;
-                                totbits = 0;
-                                in_gap = 1;
-                            }
+                if (totbits >= 22 && last_y_motion  < 0)
+                    block = 0;
+            } else {
+                /* if we're waiting for a keycode, we simply do
+                 * our match on what we have so far, filling in
+                 * the missing ones ourself.
+                 */
+                if (totbits >= 11) {
+                    static int lowbits[] = { 0,
+                        0x1, 0x3, 0x7, 0xf, 0x1f, 0x3f, 0x7f, 0xff
+                    };
+                    int needbits = wordlen - totbits;
+                    int have = bitaccum << needbits | lowbits[needbits];
+                    key_desc_t *keyp = lookup_key(have); 
+                    if (keyp) {
+                        if (keyp->ir_code == have ||
+                            (keyp->ir_code ^ IR_UP_MASK) == have) {
+                            dbgchar(2,'e');
+                            emitkey(have);
+                            bitaccum = 0;
+                            totbits = 0;
+                            in_gap = 1;
                         }
                     }
                 }
             }
         }
     }
+    return 0;
+}
+
+/*
+ * start one of the worker threads.  if we're running with realtime
+ * priority, it gets the given SCHED_FIFO priority, otherwise it runs
+ * as an ordinary thread.  stacks are kept small, since with '-r'
+ * they're locked into memory.
+ */
+void
+start_thread(void *(*fn)(void *), char *name, int realtime, int prio)
+{
+    pthread_attr_t attr;
+    struct sched_param sparam;
+    pthread_t tid;
+    int e;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    memset(&sparam, 0, sizeof(sparam));
+    if (realtime && prio) {
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        sparam.sched_priority = prio;
+    } else {
+        pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    }
+    pthread_attr_setschedparam(&attr, &sparam);
+
+    if ((e = pthread_create(&tid, &attr, fn, 0))) {
+        errno = e;
+        die("unable to start %s thread", name);
+    }
+    pthread_attr_destroy(&attr);
+
+    dbg(1, "started %s thread, priority %d", name, sparam.sched_priority);
 }
 
 int
 main(int argc, char *argv[])
 {
     char *p;
-    char *lircdhost = 0, *term = 0;
-    int lircdport = LIRCD_UDP_PORT;
+    char *term = 0;
     int foreground = 0;
     int realtime = 0;
+    int prio = 0;
     int wait_term = 0;
-    int tcp = 0;
     int speed = B38400;
     int tty = -1;
     int got_speeds = 0;
@@ -1091,7 +1814,7 @@ main(int argc, char *argv[])
     p = strrchr(argv[0], '/');
     if (p) me = p + 1;
 
-    while ((c = getopt(argc, argv, "t:Hw:flrdXh:p:Tas:m:g")) != EOF) {
+    while ((c = getopt(argc, argv, "t:HB:w:W:flrdXF:h:p:Tas:m:gi:")) != EOF) {
         switch (c) {
 
         /* tty options */
@@ -1101,11 +1824,21 @@ main(int argc, char *argv[])
         case 'H':
             speed = B115200;
             break;
+        case 'B':
+            tty_fast_rate = tty_parse_rate(optarg);
+            if (!tty_fast_rate)
+                usage();
+            break;
         case 'w':
             wait_term = atoi(optarg);
             if (wait_term == 0)
                 usage();
             break;
+        case 'W':
+            tty_watch = atoi(optarg);
+            if (tty_watch < TTY_MIN_WATCH)
+                usage();
+            break;
 
         /* daemon options */
         case 'f':
@@ -1123,6 +1856,9 @@ main(int argc, char *argv[])
         case 'X':
             noxmit = 1;
             break;
+        case 'F':
+            flightrec_path = optarg;
+            break;
 
 
         /* lircd options */
@@ -1141,7 +1877,7 @@ main(int argc, char *argv[])
              *       nc -l -p 8807
              *   done | nc -u localhost 8765
              */
-            tcp = 1;
+            lircd_tcp = 1;
             break;
 
         /* airboard options */
@@ -1182,6 +1918,15 @@ main(int argc, char *argv[])
             do_grabscroll = 1;
             break;
 
+        case 'i':
+            interp_hz = atoi(optarg);
+            if (interp_hz <= 0 || interp_hz > 1000) {
+                fprintf(stderr,
+                    "%s: interpolation rate must be 1 to 1000 Hz.\n", me);
+                usage();
+            }
+            break;
+
         default:
             usage();
             break;
@@ -1211,9 +1956,9 @@ main(int argc, char *argv[])
     exit(0);
 #endif
 
-    if ((spec_host || got_speeds) && !airboard) {
+    if ((spec_host || got_speeds || interp_hz) && !airboard) {
         fprintf(stderr,
-            "%s: using '-s' or '-m' without '-a' makes no sense.\n", me);
+            "%s: using '-s', '-m' or '-i' without '-a' makes no sense.\n", me);
         usage();
     }
 
@@ -1221,12 +1966,22 @@ main(int argc, char *argv[])
         usage();
     }
 
+    /* the switch is always asked for at the device's 38400 */
+    if (tty_fast_rate && speed != B38400)
+        usage();
+
     report("starting airboard-ir %s", VERSION);
 
     /* initialize uinput, if needed */
     if (airboard && !noxmit && setup_uinput() < 0)
         die("%s: unable to find uinput device\n", me);
 
+    if (interp_hz && !noxmit)
+        interp_init();
+
+    if (do_grabscroll)
+        scroll_accel_init();
+
     /* do the initial tty open here, so access/existence is checked
      * before daemonize or muck with the scheduler.
      */
@@ -1237,8 +1992,9 @@ main(int argc, char *argv[])
     signal(SIGINT, sighandler);
     signal(SIGQUIT, sighandler);
     signal(SIGABRT, sighandler);
-    signal(SIGUSR1, sighandler);
-    signal(SIGUSR2, sighandler);
+    signal(SIGUSR1, statshandler);
+    signal(SIGUSR2, flighthandler);
+    flightrec_init(me);
 
     if (realtime) {
         struct sched_param sparam;
@@ -1254,7 +2010,8 @@ main(int argc, char *argv[])
         min = sched_get_priority_min(SCHED_FIFO);
         max = sched_get_priority_max(SCHED_FIFO);
 
-        sparam.sched_priority = (min + max)/2; /* probably always 50 */
+        prio = (min + max)/2; /* probably always 50 */
+        sparam.sched_priority = prio;
         if (sched_setscheduler(0, SCHED_FIFO, &sparam))
             die("unable to set SCHED_FIFO");
 
@@ -1271,163 +2028,45 @@ main(int argc, char *argv[])
         daemonized = 1;
     }
 
+    /* from here on, messages go through the log thread */
+    log_start();
+
+    /* the tty reader (this thread) feeds the decoder, which is
+     * just below it in priority, and the network worker, which runs
+     * as an ordinary process so that it can never hold up input.
+     * (threads don't survive daemon(), so this comes after it.)
+     */
+    if (airboard) {
+        ring_init(&airboard_ring);
+        start_thread(airboard_loop, "airboard", realtime, prio - 1);
+    }
+    if (!noxmit && (lircdhost || spec_host)) {
+        dest_init(&lircd_dest, lircdhost, lircdport, lircd_tcp);
+        dest_init(&spec_dest, spec_host, spec_port, 0);
+        ring_init(&lircd_ring);
+        ring_init(&hotkey_ring);
+        start_thread(net_loop, "network", realtime, 0);
+        net_thread_running = 1;
+    }
+
     while (1) {
 
         if (tty < 0)
             tty = tty_init(term, wait_term, speed);
 
-        data_loop(tty, tcp, lircdhost, lircdport);
+        data_loop(tty);
 
         /* we'll only ever return from data_loop() if our read()
          * returns 0, which usually means our (USB-based) tty has
-         * gone away.  loop if we were told to wait (-w) for it.
+         * gone away, or if the watchdog fired.  loop if we were
+         * told to wait (-w) for it, or to watch it (-W).
          */
-        if (!wait_term)
+        if (!wait_term && !tty_watch)
             die("end-of-dataloop");
 
-        tty_restore();
-        close(tty);
+        tty_release(tty);
         tty = -1;
     }
 
     return 0;
 }
-
-
-key_desc_t keys[NUM_KEYS] = {
-
-    { 0x00e1e, "up",            KEY_UP,         0 },
-    { 0x01e1c, "key_e",         KEY_E,          0 },
-    { 0x02e1a, "f4",            KEY_F4, 0 },
-    { 0x03e18, "key_n",         KEY_N,          0 },
-    { 0x04e16, "video",         KEY_VIDEO,      TYPE_SPECIAL },
-    { 0x05e14, "key_2",         KEY_2,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x07e10, "key_g",         KEY_G,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x09e0c, "l_bracket",     KEY_LEFTBRACE,  0 },
-    { 0x0ae0a, "f12",           KEY_F12,        0 },
-    { 0x0be08, "volup",         KEY_VOLUMEUP,   TYPE_SPECIAL },
-    { 0x00000, "",              0,              0 },
-    { 0x0de04, "key_0",         KEY_0,          0 },
-    { 0x0ee02, "right_joy_but", BTN_RIGHT,      TYPE_MOUSE },
-    { 0x0fe00, "enter",         KEY_ENTER,      0 },
-    { 0x10e3e, "rightmeta",     KEY_RIGHTMETA,  0 },
-    { 0x11e3c, "key_u",         KEY_U,          0 },
-    { 0x12e3a, "f8",            KEY_F8, 0 },
-    { 0x13e38, "slash",         KEY_SLASH,      0 },
-    { 0x14e36, "pause",         KEY_PLAYPAUSE,  TYPE_SPECIAL },
-    { 0x15e34, "key_6",         KEY_6,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x17e30, "key_l",         KEY_L,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x19e2c, "key_a",         KEY_A,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x1be28, "display",       KEY_DISPLAYTOGGLE,      TYPE_SPECIAL },
-    { 0x1ce26, "left",          KEY_LEFT,       0 },
-    { 0x1de24, "backspace",     KEY_BACKSPACE,  0 },
-    { 0x1ee22, "left_joy_but",  BTN_LEFT,       TYPE_MOUSE },
-    { 0x1fe20, "key_x",         KEY_X,          0 },
-    { 0x20e5e, "end",           KEY_END,        0 },
-    { 0x21e5c, "key_q",         KEY_Q,          0 },
-    { 0x22e5a, "f2",            KEY_F2, 0 },
-    { 0x23e58, "key_v",         KEY_V,          0 },
-    { 0x24e56, "close",         KEY_CLOSE,      TYPE_SPECIAL },
-    { 0x25e54, "backtick",      KEY_GRAVE,      0 },
-    { 0x00000, "",              0,              0 },
-    { 0x27e50, "key_d",         KEY_D,          0 },
-    { 0x28e4e, "right",         KEY_RIGHT,      0 },
-    { 0x29e4c, "key_o",         KEY_O,          0 },
-    { 0x2ae4a, "f10",           KEY_F10,        0 },
-    { 0x2be48, "r_shift",       KEY_RIGHTSHIFT, 0 },
-    { 0x2ce46, "stop",          KEY_STOP,       TYPE_SPECIAL },
-    { 0x2de44, "key_8",         KEY_8,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x2fe40, "apostrophe",    KEY_APOSTROPHE, 0 },
-    { 0x30e7e, "pgup",          KEY_PAGEUP,     0 },
-    { 0x31e7c, "key_t",         KEY_T,          0 },
-    { 0x32e7a, "f6",            KEY_F6, 0 },
-    { 0x33e78, "comma",         KEY_COMMA,      0 },
-    { 0x34e76, "u_p",   KEY_MACRO,              TYPE_SPECIAL },
-    { 0x35e74, "key_4",         KEY_4,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x37e70, "key_j",         KEY_J,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x39e6c, "backslash",     KEY_BACKSLASH,  0 },
-    { 0x3ae6a, "scroll_lock",   KEY_SCROLLLOCK, 0 },
-    { 0x3be68, "space",         KEY_SPACE,      0 },
-    { 0x3ce66, "voldown",       KEY_VOLUMEDOWN, TYPE_SPECIAL },
-    { 0x3de64, "equal",         KEY_EQUAL,      0 },
-    { 0x3ee62, "hold_joy_but",  BTN_MIDDLE,     TYPE_MOUSE },
-    { 0x00000, "",              0,              0 },
-    { 0x40e9e, "fn",            KEY_FN,         TYPE_GRAB },
-    { 0x41e9c, "key_w",         KEY_W,          0 },
-    { 0x42e9a, "f3",            KEY_F3, 0 },
-    { 0x43e98, "key_b",         KEY_B,          0 },
-    { 0x44e96, "cd",            KEY_CD,         TYPE_SPECIAL },
-    { 0x45e94, "key_1",         KEY_1,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x47e90, "key_f",         KEY_F,          0 },
-    { 0x48e8e, "numlock",       KEY_NUMLOCK,    0 },
-    { 0x49e8c, "key_p",         KEY_P,          0 },
-    { 0x4ae8a, "f11",           KEY_F11,        0 },
-    { 0x4be88, "ctrl",          KEY_LEFTCTRL,   0 },
-    { 0x4ce86, "next",          KEY_NEXT,       TYPE_SPECIAL },
-    { 0x4de84, "key_9",         KEY_9,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x00000, "",              0,              0 },
-    { 0x50ebe, "pgdn",          KEY_PAGEDOWN,   0 },
-    { 0x51ebc, "key_y",         KEY_Y,          0 },
-    { 0x52eba, "f7",            KEY_F7, 0 },
-    { 0x53eb8, "period",        KEY_DOT,        0 },
-    { 0x54eb6, "prev",          KEY_PREVIOUS,   TYPE_SPECIAL },
-    { 0x55eb4, "key_5",         KEY_5,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x57eb0, "key_k",         KEY_K,          0 },
-    { 0x00000, "",              0,              0 },
-#if PERSONAL_HACKS
-    { 0x59eac, "capcontrol",    KEY_LEFTCTRL,   0 },
-    { 0x5aeaa, "fake_btn",      BTN_MIDDLE,     TYPE_MOUSE },
-#else
-    { 0x59eac, "capslock",      KEY_CAPSLOCK,   0 },
-    { 0x5aeaa, "pause_break",   KEY_PAUSE,      0 },
-#endif
-    { 0x5bea8, "r_alt",         KEY_RIGHTALT,   0 },
-    { 0x5cea6, "leftmeta",      KEY_LEFTMETA,   0 },
-    { 0x5dea4, "all_up!",       0,              TYPE_ALL_UP },
-    { 0x5eea2, "esc",           KEY_ESC,        0 },
-    { 0x5fea0, "key_z",         KEY_Z,          0 },
-    { 0x60ede, "home",          KEY_HOME,       0 },
-    { 0x61edc, "tab",           KEY_TAB,        0 },
-    { 0x62eda, "f1",            KEY_F1, 0 },
-    { 0x63ed8, "key_c",         KEY_C,          0 },
-    { 0x64ed6, "r_ctrl",        KEY_RIGHTCTRL,  0 },
-    { 0x65ed4, "repeatcode",    0,              TYPE_REPEAT },
-    { 0x00000, "",              0,              0 },
-    { 0x67ed0, "key_s",         KEY_S,          0 },
-    { 0x68ece, "menu",          KEY_MENU,       0 },
-    { 0x69ecc, "key_i",         KEY_I,          0 },
-    { 0x6aeca, "f9",            KEY_F9, 0 },
-    { 0x6bec8, "mute",          KEY_MUTE,       TYPE_SPECIAL },
-    { 0x6cec6, "play",          KEY_PLAY,       TYPE_SPECIAL },
-    { 0x6dec4, "key_7",         KEY_7,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x6fec0, "semicolon",     KEY_SEMICOLON,  0 },
-    { 0x70efe, "down",          KEY_DOWN,       0 },
-    { 0x71efc, "key_r",         KEY_R,          0 },
-    { 0x72efa, "f5",            KEY_F5, 0 },
-    { 0x73ef8, "key_m",         KEY_M,          0 },
-    { 0x74ef6, "www",           KEY_WWW,        TYPE_SPECIAL },
-    { 0x75ef4, "key_3",         KEY_3,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x77ef0, "key_h",         KEY_H,          0 },
-    { 0x00000, "",              0,              0 },
-    { 0x79eec, "r_bracket",     KEY_RIGHTBRACE, 0 },
-    { 0x7aeea, "prtsc_sysrq",   KEY_PRINT,      0 },
-    { 0x7bee8, "l_alt",         KEY_LEFTALT,    0 },
-    { 0x7cee6, "del",           KEY_DELETE,     0 },
-    { 0x7dee4, "minus",         KEY_MINUS,      0 },
-    { 0x00000, "",              0,              0 },  /* 0x7e, mouse prefix */
-    { 0x7fee0, "l_shift",       KEY_LEFTSHIFT,  0 },
-
-};
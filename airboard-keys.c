@@ -0,0 +1,179 @@
+/*
+ * airboard-keys.c
+ *
+ * the airboard's keycodes.  see airboard.h, and the "keyboard
+ * protocol" comment in airboard-ir.c.
+ *
+ **********
+ *
+ * Copyright (C) 2009, Paul G Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <string.h>
+#include <linux/input.h>
+
+#include "airboard.h"
+
+key_desc_t keys[NUM_KEYS] = {
+
+    { 0x00e1e, "up",            KEY_UP,         0 },
+    { 0x01e1c, "key_e",         KEY_E,          0 },
+    { 0x02e1a, "f4",            KEY_F4, 0 },
+    { 0x03e18, "key_n",         KEY_N,          0 },
+    { 0x04e16, "video",         KEY_VIDEO,      TYPE_SPECIAL },
+    { 0x05e14, "key_2",         KEY_2,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x07e10, "key_g",         KEY_G,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x09e0c, "l_bracket",     KEY_LEFTBRACE,  0 },
+    { 0x0ae0a, "f12",           KEY_F12,        0 },
+    { 0x0be08, "volup",         KEY_VOLUMEUP,   TYPE_SPECIAL },
+    { 0x00000, "",              0,              0 },
+    { 0x0de04, "key_0",         KEY_0,          0 },
+    { 0x0ee02, "right_joy_but", BTN_RIGHT,      TYPE_MOUSE },
+    { 0x0fe00, "enter",         KEY_ENTER,      0 },
+    { 0x10e3e, "rightmeta",     KEY_RIGHTMETA,  0 },
+    { 0x11e3c, "key_u",         KEY_U,          0 },
+    { 0x12e3a, "f8",            KEY_F8, 0 },
+    { 0x13e38, "slash",         KEY_SLASH,      0 },
+    { 0x14e36, "pause",         KEY_PLAYPAUSE,  TYPE_SPECIAL },
+    { 0x15e34, "key_6",         KEY_6,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x17e30, "key_l",         KEY_L,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x19e2c, "key_a",         KEY_A,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x1be28, "display",       KEY_DISPLAYTOGGLE,      TYPE_SPECIAL },
+    { 0x1ce26, "left",          KEY_LEFT,       0 },
+    { 0x1de24, "backspace",     KEY_BACKSPACE,  0 },
+    { 0x1ee22, "left_joy_but",  BTN_LEFT,       TYPE_MOUSE },
+    { 0x1fe20, "key_x",         KEY_X,          0 },
+    { 0x20e5e, "end",           KEY_END,        0 },
+    { 0x21e5c, "key_q",         KEY_Q,          0 },
+    { 0x22e5a, "f2",            KEY_F2, 0 },
+    { 0x23e58, "key_v",         KEY_V,          0 },
+    { 0x24e56, "close",         KEY_CLOSE,      TYPE_SPECIAL },
+    { 0x25e54, "backtick",      KEY_GRAVE,      0 },
+    { 0x00000, "",              0,              0 },
+    { 0x27e50, "key_d",         KEY_D,          0 },
+    { 0x28e4e, "right",         KEY_RIGHT,      0 },
+    { 0x29e4c, "key_o",         KEY_O,          0 },
+    { 0x2ae4a, "f10",           KEY_F10,        0 },
+    { 0x2be48, "r_shift",       KEY_RIGHTSHIFT, 0 },
+    { 0x2ce46, "stop",          KEY_STOP,       TYPE_SPECIAL },
+    { 0x2de44, "key_8",         KEY_8,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x2fe40, "apostrophe",    KEY_APOSTROPHE, 0 },
+    { 0x30e7e, "pgup",          KEY_PAGEUP,     0 },
+    { 0x31e7c, "key_t",         KEY_T,          0 },
+    { 0x32e7a, "f6",            KEY_F6, 0 },
+    { 0x33e78, "comma",         KEY_COMMA,      0 },
+    { 0x34e76, "u_p",   KEY_MACRO,              TYPE_SPECIAL },
+    { 0x35e74, "key_4",         KEY_4,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x37e70, "key_j",         KEY_J,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x39e6c, "backslash",     KEY_BACKSLASH,  0 },
+    { 0x3ae6a, "scroll_lock",   KEY_SCROLLLOCK, 0 },
+    { 0x3be68, "space",         KEY_SPACE,      0 },
+    { 0x3ce66, "voldown",       KEY_VOLUMEDOWN, TYPE_SPECIAL },
+    { 0x3de64, "equal",         KEY_EQUAL,      0 },
+    { 0x3ee62, "hold_joy_but",  BTN_MIDDLE,     TYPE_MOUSE },
+    { 0x00000, "",              0,              0 },
+    { 0x40e9e, "fn",            KEY_FN,         TYPE_GRAB },
+    { 0x41e9c, "key_w",         KEY_W,          0 },
+    { 0x42e9a, "f3",            KEY_F3, 0 },
+    { 0x43e98, "key_b",         KEY_B,          0 },
+    { 0x44e96, "cd",            KEY_CD,         TYPE_SPECIAL },
+    { 0x45e94, "key_1",         KEY_1,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x47e90, "key_f",         KEY_F,          0 },
+    { 0x48e8e, "numlock",       KEY_NUMLOCK,    0 },
+    { 0x49e8c, "key_p",         KEY_P,          0 },
+    { 0x4ae8a, "f11",           KEY_F11,        0 },
+    { 0x4be88, "ctrl",          KEY_LEFTCTRL,   0 },
+    { 0x4ce86, "next",          KEY_NEXT,       TYPE_SPECIAL },
+    { 0x4de84, "key_9",         KEY_9,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x00000, "",              0,              0 },
+    { 0x50ebe, "pgdn",          KEY_PAGEDOWN,   0 },
+    { 0x51ebc, "key_y",         KEY_Y,          0 },
+    { 0x52eba, "f7",            KEY_F7, 0 },
+    { 0x53eb8, "period",        KEY_DOT,        0 },
+    { 0x54eb6, "prev",          KEY_PREVIOUS,   TYPE_SPECIAL },
+    { 0x55eb4, "key_5",         KEY_5,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x57eb0, "key_k",         KEY_K,          0 },
+    { 0x00000, "",              0,              0 },
+#if PERSONAL_HACKS
+    { 0x59eac, "capcontrol",    KEY_LEFTCTRL,   0 },
+    { 0x5aeaa, "fake_btn",      BTN_MIDDLE,     TYPE_MOUSE },
+#else
+    { 0x59eac, "capslock",      KEY_CAPSLOCK,   0 },
+    { 0x5aeaa, "pause_break",   KEY_PAUSE,      0 },
+#endif
+    { 0x5bea8, "r_alt",         KEY_RIGHTALT,   0 },
+    { 0x5cea6, "leftmeta",      KEY_LEFTMETA,   0 },
+    { 0x5dea4, "all_up!",       0,              TYPE_ALL_UP },
+    { 0x5eea2, "esc",           KEY_ESC,        0 },
+    { 0x5fea0, "key_z",         KEY_Z,          0 },
+    { 0x60ede, "home",          KEY_HOME,       0 },
+    { 0x61edc, "tab",           KEY_TAB,        0 },
+    { 0x62eda, "f1",            KEY_F1, 0 },
+    { 0x63ed8, "key_c",         KEY_C,          0 },
+    { 0x64ed6, "r_ctrl",        KEY_RIGHTCTRL,  0 },
+    { 0x65ed4, "repeatcode",    0,              TYPE_REPEAT },
+    { 0x00000, "",              0,              0 },
+    { 0x67ed0, "key_s",         KEY_S,          0 },
+    { 0x68ece, "menu",          KEY_MENU,       0 },
+    { 0x69ecc, "key_i",         KEY_I,          0 },
+    { 0x6aeca, "f9",            KEY_F9, 0 },
+    { 0x6bec8, "mute",          KEY_MUTE,       TYPE_SPECIAL },
+    { 0x6cec6, "play",          KEY_PLAY,       TYPE_SPECIAL },
+    { 0x6dec4, "key_7",         KEY_7,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x6fec0, "semicolon",     KEY_SEMICOLON,  0 },
+    { 0x70efe, "down",          KEY_DOWN,       0 },
+    { 0x71efc, "key_r",         KEY_R,          0 },
+    { 0x72efa, "f5",            KEY_F5, 0 },
+    { 0x73ef8, "key_m",         KEY_M,          0 },
+    { 0x74ef6, "www",           KEY_WWW,        TYPE_SPECIAL },
+    { 0x75ef4, "key_3",         KEY_3,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x77ef0, "key_h",         KEY_H,          0 },
+    { 0x00000, "",              0,              0 },
+    { 0x79eec, "r_bracket",     KEY_RIGHTBRACE, 0 },
+    { 0x7aeea, "prtsc_sysrq",   KEY_PRINT,      0 },
+    { 0x7bee8, "l_alt",         KEY_LEFTALT,    0 },
+    { 0x7cee6, "del",           KEY_DELETE,     0 },
+    { 0x7dee4, "minus",         KEY_MINUS,      0 },
+    { 0x00000, "",              0,              0 },  /* 0x7e, mouse prefix */
+    { 0x7fee0, "l_shift",       KEY_LEFTSHIFT,  0 },
+
+};
+
+key_desc_t *
+key_by_name(char *name)
+{
+    key_desc_t *keyp;
+
+    for (keyp = keys; keyp < &keys[NUM_KEYS]; keyp++)
+        if (keyp->ir_code && !strcmp(keyp->name, name))
+            return keyp;
+    return 0;
+}
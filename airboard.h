@@ -0,0 +1,65 @@
+/*
+ * airboard.h
+ *
+ * the airboard keyboard's IR report formats, and its key table --
+ * shared by airboard-ir, which decodes them, and irgen.c, which
+ * makes them up.
+ *
+ **********
+ *
+ * Copyright (C) 2009, Paul G Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef AIRBOARD_H
+#define AIRBOARD_H
+
+/* see the "keyboard protocol" and "mouse protocol" comment blocks
+ * in airboard-ir.c for descriptions of the actual binary reports.
+ * the keyboard sends them at AIRBOARD_BAUD, with a 0 start bit.
+ */
+#define AIRBOARD_BAUD 1200
+#define KEY_WORD_LEN 19
+#define MOUSE_WORD_LEN 30
+
+#define IR_UP_MASK 0x801
+#define IR_REPEAT 0x656d5
+
+#define IR_MOUSE_PREFIX 0x7e6
+#define IR_MOUSE_PREFIX_LEN 11
+
+
+typedef struct key_desc {
+    long ir_code;       /* IR code the airboard sends (9 bits) */
+    char *name;         /* for debug, and actually sent for special keys */
+    int event_code;     /* the event code for the uinput subsystem */
+    char type;          /* regular/mouse/special */
+} key_desc_t;
+
+#define NUM_KEYS 128
+
+#define TYPE_MOUSE   1
+#define TYPE_SPECIAL 2
+#define TYPE_REPEAT  3
+#define TYPE_ALL_UP  4
+#define TYPE_GRAB    5
+
+extern key_desc_t keys[NUM_KEYS];  /* in airboard-keys.c */
+
+key_desc_t *key_by_name(char *name);
+
+#endif /* AIRBOARD_H */
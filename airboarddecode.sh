@@ -1,4 +1,4 @@
-grep 'marking.*pressed at' /tmp/airboard.log |
+grep 'marking.*pressed$' /tmp/airboard.log |
     awk '{print }' |
     sed -e 's/key_//' 
 	-e 's;slash;/;' 
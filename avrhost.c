@@ -0,0 +1,1514 @@
+/*
+ * avrhost.c
+ *
+ * host-side support shared by avrlirc2udp and airboard-ir.  see
+ * avrhost.h for the interfaces.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#define _GNU_SOURCE     /* for memmem() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <limits.h>
+#include <libgen.h>
+#include <math.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <errno.h>
+
+#include "avrhost.h"
+#include "flightrec.h"
+
+/*
+ * tty
+ */
+
+/* shared by tty_init()/tty_restore().  more than one tty may be
+ * open at once (see avrlirc2udp's -t), so each one's original
+ * settings are kept.  tty_fd is the most recently opened.
+ */
+static struct {
+    int fd;
+    struct termios tios;
+} saved[TTY_MAX_OPEN];
+static int nsaved;
+int tty_fd = -1;
+
+/* the rate we'd like, if not 0.  see tty_handshake() */
+int tty_fast_rate;
+
+/* how much framer_read() asks for from the tty, adjusted by tuning */
+int tty_readsize = TTY_READSIZE;
+
+/*
+ * what we learn about the tty in its first TUNE_READS reads.  see
+ * tty_observe().
+ */
+static struct {
+    int active;
+    int reads;
+    long bytes;
+    int minchunk, maxchunk;
+    int gaps;
+    double gapsum, gapsq;       /* intra-burst gaps between reads, usec */
+    struct timespec last;
+} tune;
+
+static void
+tty_vmin(int vmin)
+{
+    struct termios tios;
+
+    if (tcgetattr(tty_fd, &tios) < 0)
+        return;
+    tios.c_cc[VMIN] = vmin;
+    tcsetattr(tty_fd, TCSANOW, &tios);
+}
+
+/*
+ * usb-serial adapters hold received bytes for up to latency_timer
+ * ms (16, for FTDI parts) hoping to fill a packet, and the kernel
+ * may defer tty processing unless low_latency is set.  either one
+ * costs far more than a whole IR word takes to arrive.  ask for
+ * the fastest delivery we can get.
+ */
+static void
+tty_low_latency(char *term)
+{
+    struct serial_struct ss;
+    char path[PATH_MAX], real[PATH_MAX];
+    FILE *fp;
+    int ms;
+
+    if (ioctl(tty_fd, TIOCGSERIAL, &ss) == 0) {
+        if (!(ss.flags & ASYNC_LOW_LATENCY)) {
+            ss.flags |= ASYNC_LOW_LATENCY;
+            if (ioctl(tty_fd, TIOCSSERIAL, &ss) == 0)
+                report("tty: low_latency set");
+            else
+                report("tty: can't set low_latency");
+        }
+    }
+
+    if (!realpath(term, real))
+        return;
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/device/latency_timer",
+            basename(real));
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return;         /* not a usb-serial adapter that has one */
+    if (fscanf(fp, "%d", &ms) != 1)
+        ms = -1;
+    fclose(fp);
+    if (ms <= TTY_LATENCY_MS)
+        return;
+
+    fp = fopen(path, "w");
+    if (fp) {
+        fprintf(fp, "%d\n", TTY_LATENCY_MS);
+        if (fclose(fp) == 0) {
+            report("tty: latency_timer %d -> %d ms", ms, TTY_LATENCY_MS);
+            return;
+        }
+    }
+    report("tty: latency_timer is %d ms, and isn't writable", ms);
+}
+
+/*
+ * watch the first few bursts, and settle our read size to suit how
+ * the bytes actually arrive.  it just needs to comfortably swallow
+ * the largest chunk the adapter hands over.
+ *
+ * VMIN stays at 2, VTIME 0, so we wake for every word.  raising VMIN
+ * would save wakeups when the adapter delivers in big chunks anyway,
+ * but then the tail of a burst waits out VTIME (100ms at the least)
+ * before we see it, which costs far more than it saves.
+ */
+static void
+tty_tune_finish(void)
+{
+    double mean = 0, sd = 0;
+
+    tune.active = 0;
+
+    if (tune.gaps) {
+        mean = tune.gapsum / tune.gaps;
+        sd = tune.gapsq / tune.gaps - mean * mean;
+        sd = sd > 0 ? sqrt(sd) : 0;
+    }
+
+    tty_readsize = 64;
+    while (tty_readsize < 2 * tune.maxchunk && tty_readsize < FRAMER_BUFSIZE)
+        tty_readsize *= 2;
+
+    report("tty: %ld bytes in %d reads (%d-%d per read), "
+            "gap %.0f +/- %.0f usec; read size %d",
+            tune.bytes, tune.reads, tune.minchunk, tune.maxchunk,
+            mean, sd, tty_readsize);
+}
+
+/* called by framer_read() with the size of each tty read */
+static void
+tty_observe(int n)
+{
+    struct timespec now;
+    double gap;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (tune.reads) {
+        gap = (now.tv_sec - tune.last.tv_sec) * 1e6 +
+                (now.tv_nsec - tune.last.tv_nsec) / 1e3;
+        if (gap < TUNE_BURST_GAP) {
+            tune.gaps++;
+            tune.gapsum += gap;
+            tune.gapsq += gap * gap;
+        }
+    }
+    tune.last = now;
+
+    if (!tune.reads || n < tune.minchunk)
+        tune.minchunk = n;
+    if (n > tune.maxchunk)
+        tune.maxchunk = n;
+    tune.bytes += n;
+
+    if (++tune.reads >= TUNE_READS)
+        tty_tune_finish();
+}
+
+static void tty_watch_start(void);
+static void tty_watch_end(void);
+
+/* put back the original settings of every tty we have open */
+void
+tty_restore(void)
+{
+    int i;
+
+    if (tty_fd >= 0)
+        tty_watch_end();
+    for (i = 0; i < nsaved; i++)
+        tcsetattr(saved[i].fd, TCSADRAIN, &saved[i].tios);
+}
+
+/* restore and close just one tty */
+void
+tty_release(int fd)
+{
+    int i;
+
+    for (i = 0; i < nsaved; i++) {
+        if (saved[i].fd == fd) {
+            tcsetattr(fd, TCSADRAIN, &saved[i].tios);
+            saved[i] = saved[--nsaved];
+            break;
+        }
+    }
+    if (fd == tty_fd) {
+        tty_watch_end();
+        tty_fd = -1;
+    }
+    close(fd);
+}
+
+/*
+ * is this a by-id name for 'serial'?  udev names them
+ * "usb-<vendor>_<product>_<serial>-if<nn>...", so the serial must
+ * be the whole field between a '_' and the "-if".  a serial given
+ * with its own "-if<nn>" picks one port of a multi-port adapter.
+ */
+static int
+tty_serial_match(char *name, char *serial)
+{
+    int len = strlen(serial);
+    int has_if = strstr(serial, "-if") != 0;
+    char *p = name;
+
+    while ((p = strstr(p, serial)) != 0) {
+        if (p > name && p[-1] == '_') {
+            if (!strncmp(p + len, "-if", 3))
+                return 1;
+            if (has_if && (p[len] == '-' || p[len] == '\0'))
+                return 1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+/*
+ * turn a tty name into a path.  "usb:<serial>" is looked up in
+ * udev's /dev/serial/by-id links, so the device is found no matter
+ * which ttyUSB number it gets.  returns 0 (with errno ENOENT) if
+ * there's no match yet, or (with ENOTUNIQ) if more than one link
+ * matches.
+ */
+char *
+tty_resolve(char *term)
+{
+    static char path[PATH_MAX];
+    char *serial, *found = 0;
+    struct dirent *de;
+    DIR *dir;
+
+    if (strncmp(term, TTY_USB_PREFIX, strlen(TTY_USB_PREFIX)))
+        return term;
+
+    serial = term + strlen(TTY_USB_PREFIX);
+    dir = opendir(TTY_BY_ID);
+    if (dir) {
+        while ((de = readdir(dir)) != 0) {
+            if (!tty_serial_match(de->d_name, serial))
+                continue;
+            if (found) {
+                report("tty: '%s' matches both %s and %s", term,
+                        found, de->d_name);
+                closedir(dir);
+                errno = ENOTUNIQ;
+                return 0;
+            }
+            snprintf(path, sizeof(path), "%s/%s", TTY_BY_ID, de->d_name);
+            found = path + strlen(TTY_BY_ID) + 1;
+        }
+        closedir(dir);
+        if (found)
+            return path;
+    }
+    errno = ENOENT;
+    return 0;
+}
+
+/*
+ * wait for 'term' to (possibly) have appeared, or (if for_perms) for
+ * its permissions to change.  we watch the closest directory on its path
+ * that exists, since /dev/serial/by-id itself vanishes when the last
+ * usb-serial device is unplugged.  any change there wakes us up, and
+ * the caller just tries again.  if inotify isn't available, this is
+ * just a sleep.
+ */
+static void
+tty_wait_arrival(char *term, int secs, int for_perms)
+{
+    char dir[PATH_MAX];
+    struct pollfd pfd;
+    char *path, *p;
+    int ifd;
+
+    ifd = inotify_init1(IN_CLOEXEC);
+    if (ifd < 0) {
+        sleep(secs);
+        return;
+    }
+
+    path = tty_resolve(term);
+    if (path)
+        snprintf(dir, sizeof(dir), "%s", path);
+    else
+        snprintf(dir, sizeof(dir), "%s/", TTY_BY_ID);
+
+    while (1) {
+        p = strrchr(dir, '/');
+        if (!p || p == dir)
+            strcpy(dir, "/");
+        else
+            *p = '\0';
+        if (inotify_add_watch(ifd, dir, IN_CREATE|IN_MOVED_TO|IN_ATTRIB) >= 0)
+            break;
+        if (!strcmp(dir, "/")) {
+            close(ifd);
+            sleep(secs);
+            return;
+        }
+    }
+
+    /* it may have shown up while we were setting up */
+    path = tty_resolve(term);
+    if (for_perms || !path || access(path, F_OK) != 0) {
+        pfd.fd = ifd;
+        pfd.events = POLLIN;
+        poll(&pfd, 1, secs * 1000);
+    }
+
+    close(ifd);
+}
+
+/* validate a -B argument.  returns the rate, or 0 */
+int
+tty_parse_rate(char *s)
+{
+    int rate = atoi(s);
+
+    if (rate != 76800 && rate != 250000 && rate != 500000)
+        return 0;
+    return rate;
+}
+
+/*
+ * send the command character for our fast rate, with the tty at
+ * 'rate', and see if we get the proper answer back.  anything else
+ * in the input (IR data, junk from a mismatched rate) is ignored.
+ */
+static int
+tty_ask(int rate, struct termios *base)
+{
+    char cmd, want[16], buf[256];
+    struct pollfd pfd;
+    int n, len = 0;
+
+    if (tty_fast_rate == 76800)
+        cmd = '7';
+    else
+        cmd = (tty_fast_rate == 250000) ? '2' : '5';
+
+    if (rate == TTY_BASE_RATE) {
+        if (tcsetattr(tty_fd, TCSANOW, base) < 0)
+            return 0;
+    } else if (tty_set_rate(tty_fd, rate) < 0) {
+        return 0;
+    }
+    tcflush(tty_fd, TCIOFLUSH);
+
+    if (write(tty_fd, &cmd, 1) != 1)
+        return 0;
+
+    snprintf(want, sizeof(want), "%d\r\n", tty_fast_rate);
+
+    pfd.fd = tty_fd;
+    pfd.events = POLLIN;
+    while (len < sizeof(buf) && poll(&pfd, 1, HANDSHAKE_MS) > 0) {
+        n = read(tty_fd, buf + len, sizeof(buf) - len);
+        if (n <= 0)
+            break;
+        len += n;
+        if (memmem(buf, len, want, strlen(want)))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * get the device running at tty_fast_rate.  it may already be there
+ * (if we've been restarted), so try that first.  otherwise ask for
+ * the switch at 38400, and then ask again at the new rate, which
+ * also confirms it to the device.  if anything goes wrong, we're
+ * left at 38400, which the device will also return to on its own.
+ */
+static void
+tty_handshake(struct termios *tios)
+{
+    struct termios base = *tios;
+
+    /* the answers are short, so don't let VMIN hold them up */
+    base.c_cc[VMIN] = 1;
+    tcsetattr(tty_fd, TCSANOW, &base);
+
+    if (tty_ask(tty_fast_rate, &base)) {
+        report("tty: device already at %d baud", tty_fast_rate);
+    } else if (tty_ask(TTY_BASE_RATE, &base)) {
+        tcdrain(tty_fd);
+        usleep(10000);          /* let it finish its answer, and switch */
+        if (tty_ask(tty_fast_rate, &base)) {
+            report("tty: switched to %d baud", tty_fast_rate);
+        } else {
+            report("tty: no answer at %d baud, staying at %d",
+                    tty_fast_rate, TTY_BASE_RATE);
+            tcsetattr(tty_fd, TCSANOW, tios);
+        }
+    } else {
+        report("tty: device doesn't support %d baud", tty_fast_rate);
+        tcsetattr(tty_fd, TCSANOW, tios);
+    }
+
+    tty_vmin(tios->c_cc[VMIN]);
+    tcflush(tty_fd, TCIFLUSH);
+}
+
+
+/*
+ * oscillator calibration (see cal_check() in avrlirc.c)
+ */
+
+/*
+ * wait up to 'ms' for 'want' to show up in the input, and then for
+ * the end of its line.  the line is copied to 'line'.
+ */
+static int
+tty_expect(char *want, char *line, int size, int ms)
+{
+    char buf[512], *p, *e;
+    struct pollfd pfd;
+    int n, len = 0;
+
+    pfd.fd = tty_fd;
+    pfd.events = POLLIN;
+    while (len < sizeof(buf) && poll(&pfd, 1, ms) > 0) {
+        n = read(tty_fd, buf + len, sizeof(buf) - len);
+        if (n <= 0)
+            break;
+        len += n;
+        p = memmem(buf, len, want, strlen(want));
+        if (!p)
+            continue;
+        e = memmem(p, len - (p - buf), "\r\n", 2);
+        if (!e)
+            continue;
+        n = e - p;
+        if (n >= size)
+            n = size - 1;
+        memcpy(line, p, n);
+        line[n] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+/* send a command character, and wait for an answer */
+static int
+tty_command(char cmd, char *want, char *line, int size)
+{
+    tcflush(tty_fd, TCIFLUSH);
+    if (write(tty_fd, &cmd, 1) != 1)
+        return 0;
+    return tty_expect(want, line, size, HANDSHAKE_MS);
+}
+
+/*
+ * an uncalibrated device may be too far off to understand us at its
+ * nominal rate.  look for it nearby, starting at 'rate'.  returns
+ * the rate it answered at, or 0.
+ */
+static int
+tty_find(int rate)
+{
+    char line[128];
+    int i, r;
+
+    for (i = 0; i <= 2 * CAL_SCAN / CAL_SCAN_STEP; i++) {
+        /* 0, -2%, +2%, -4%, ... */
+        r = rate + (long)rate * ((i + 1) / 2) * CAL_SCAN_STEP / 100 *
+                ((i & 1) ? -1 : 1);
+        if (tty_set_rate(tty_fd, r) < 0)
+            die("setting %d baud", r);
+        if (tty_command('h', "(v)ers", line, sizeof(line)))
+            return r;
+    }
+    return 0;
+}
+
+static void
+sleep_until(struct timespec *ts)
+{
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, 0) == EINTR)
+        ;
+}
+
+/*
+ * the device's 'U' loop is a steady stream of 0x55.  at the nominal
+ * rate, it should arrive intact.
+ */
+static int
+tty_verify(int rate)
+{
+    unsigned char buf[CAL_VERIFY_BYTES];
+    struct pollfd pfd;
+    int n, len = 0, i, good = 0, bad = 0;
+    char c = 'U';
+
+    if (tty_set_rate(tty_fd, rate) < 0)
+        die("setting %d baud", rate);
+    tcflush(tty_fd, TCIFLUSH);
+    if (write(tty_fd, &c, 1) != 1)
+        return 0;
+
+    pfd.fd = tty_fd;
+    pfd.events = POLLIN;
+    while (len < sizeof(buf) && poll(&pfd, 1, HANDSHAKE_MS) > 0) {
+        n = read(tty_fd, buf + len, sizeof(buf) - len);
+        if (n <= 0)
+            break;
+        len += n;
+    }
+
+    /* any character ends the loop.  then let the tail drain. */
+    c = '.';
+    if (write(tty_fd, &c, 1) != 1)
+        return 0;
+    usleep(50000);
+    tcflush(tty_fd, TCIFLUSH);
+
+    /* skip whatever was on its way before the loop started */
+    for (i = 0; i + 4 <= len; i++)
+        if (!memcmp(buf + i, "UUUU", 4))
+            break;
+    for (; i < len; i++) {
+        if (buf[i] == 'U')
+            good++;
+        else
+            bad++;
+    }
+
+    report("calibration check:  %d good, %d bad characters at %d baud",
+            good, bad, rate);
+    return good >= CAL_VERIFY_BYTES / 2 && bad == 0;
+}
+
+/*
+ * trim the device's oscillator, so that it runs at 'rate' (its
+ * nominal command rate), and save the result in its eeprom.
+ * returns 0 on success.
+ */
+int
+tty_calibrate(char *term, int rate)
+{
+    struct timespec t;
+    char line[128];
+    int round, r, osccal, err;
+    char c = '.';
+
+    tty_init(term, 0, B38400);
+
+    r = rate;
+    for (round = 0; round < CAL_ROUNDS; round++) {
+        r = tty_find(r);
+        if (!r) {
+            report("no answer from the device within %d%% of %d baud",
+                    CAL_SCAN, rate);
+            return -1;
+        }
+
+        if (!tty_command('c', "cal\r\n", line, sizeof(line))) {
+            report("device doesn't support calibration");
+            return -1;
+        }
+
+        /* two characters, CAL_GAP_MS apart */
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        t.tv_nsec += 50000000;
+        if (t.tv_nsec >= 1000000000) {
+            t.tv_sec++;
+            t.tv_nsec -= 1000000000;
+        }
+        sleep_until(&t);
+        if (write(tty_fd, &c, 1) != 1)
+            return -1;
+        t.tv_sec += CAL_GAP_MS / 1000;
+        sleep_until(&t);
+        if (write(tty_fd, &c, 1) != 1)
+            return -1;
+
+        if (!tty_expect("cal ", line, sizeof(line), HANDSHAKE_MS) ||
+                sscanf(line, "cal %x %x", &osccal, &err) != 2) {
+            report("no calibration result");
+            continue;
+        }
+        err = (short)err;
+
+        report("device clock %+.2f%% off, osccal now 0x%02x",
+                err / 100.0, osccal);
+        if (err <= CAL_TOL && err >= -CAL_TOL)
+            break;
+
+        /* it just moved.  look for it where it should be now. */
+        usleep(10000);
+    }
+    if (round == CAL_ROUNDS) {
+        report("calibration didn't converge");
+        return -1;
+    }
+
+    if (!tty_command('C', "saved", line, sizeof(line))) {
+        report("device didn't save its calibration");
+        return -1;
+    }
+    report("calibration saved, osccal 0x%02x", osccal);
+
+    if (!tty_verify(rate)) {
+        report("calibration check failed");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * set up the freshly opened tty_fd, found at 'path' (as resolved by
+ * tty_resolve()).  returns 0, or what failed (with errno set),
+ * leaving it to the caller to close the tty.
+ */
+static char *
+tty_setup(char *path, int speed, int handshake)
+{
+    static int hooked;
+    int s;
+    struct termios tios;
+    int flags;
+    long fflags;
+    int i;
+
+    if (!isatty(tty_fd))
+        return "isatty";
+
+    fflags = fcntl(tty_fd, F_GETFL);
+    fcntl(tty_fd, F_SETFL, fflags & ~O_NDELAY);
+
+    s = tcgetattr(tty_fd, &tios);
+    if (s < 0)
+        return "tcgetattr";
+
+    /* a reopened tty may reuse an old descriptor */
+    for (i = 0; i < nsaved; i++)
+        if (saved[i].fd == tty_fd)
+            break;
+    if (i == TTY_MAX_OPEN) {
+        errno = EMFILE;
+        return "too many ttys";
+    }
+    saved[i].fd = tty_fd;
+    saved[i].tios = tios;
+    if (i == nsaved)
+        nsaved++;
+
+    /* set up restore hook quickly */
+    if (!hooked) {
+        atexit(tty_restore);
+        hooked = 1;
+    }
+
+    tios.c_oflag = 0;   /* no output flags at all */
+    tios.c_lflag = 0;   /* no line flags at all */
+
+    tios.c_cflag &= ~PARENB;    /* disable parity, both in and out */
+    tios.c_cflag |= CSTOPB|CLOCAL|CS8|CREAD;   /* two stop bits on transmit */
+                                            /* no modem control, 8bit chars, */
+                                            /* receiver enabled, */
+
+    tios.c_iflag = IGNBRK | IGNPAR;    /* ignore break, ignore parity errors */
+
+    tios.c_cc[VMIN] = 2;
+    tios.c_cc[VTIME] = 0;
+    tios.c_cc[VSUSP]  = _POSIX_VDISABLE;
+    tios.c_cc[VSTART] = _POSIX_VDISABLE;
+    tios.c_cc[VSTOP]  = _POSIX_VDISABLE;
+
+    s = cfsetspeed(&tios, speed);
+    if (s < 0)
+        return "cfsetspeed";
+    s = tcsetattr(tty_fd, TCSAFLUSH, &tios);
+    if (s < 0)
+        return "tcsetattr";
+
+    tty_low_latency(path);
+
+    if (tty_fast_rate && handshake)
+        tty_handshake(&tios);
+
+    memset(&tune, 0, sizeof(tune));
+    tune.active = 1;
+    tty_readsize = TTY_READSIZE;
+
+    tty_watch_start();
+
+    /* make sure RTS and DTR lines are high, since device may be
+     * phantom-powered.  no termios/posix way to do this, that i
+     * know of.
+     */
+    if (ioctl(tty_fd, TIOCMGET, &flags) >= 0) {
+        flags &= ~TIOCM_RTS;
+        flags &= ~TIOCM_DTR;
+        ioctl(tty_fd, TIOCMSET, &flags);
+    }
+
+    return 0;
+}
+
+/*
+ * open a tty that's expected to be there, without waiting, dying,
+ * or doing the -B handshake (which could take a second or more).
+ * returns the fd, or -1 (with errno set, and nothing left open).
+ */
+int
+tty_try_open(char *term, int speed)
+{
+    char *path, *why;
+    int e;
+
+    path = tty_resolve(term);
+    tty_fd = path ? open(path, O_RDWR|O_NDELAY) : -1;
+    if (tty_fd < 0)
+        return -1;
+
+    why = tty_setup(path, speed, 0);
+    if (why) {
+        e = errno;
+        tty_release(tty_fd);
+        errno = e;
+        return -1;
+    }
+    return tty_fd;
+}
+
+int
+tty_init(char *term, int wait_term, int speed)
+{
+    int logged = 0;
+    char *path, *why;
+    int e;
+
+    while(1) {
+        /* don't block waiting for carrier */
+        path = tty_resolve(term);
+        tty_fd = path ? open(path, O_RDWR|O_NDELAY) : -1;
+        if (tty_fd >= 0 || !wait_term)
+            break;
+
+        /* a fresh node may not have its permissions fixed yet */
+        e = errno;
+        if (e != ENOENT && !(e == EACCES && logged))
+            break;
+
+        if (!logged)
+            report("waiting for tty creation");
+
+        logged = 1;
+
+        tty_wait_arrival(term, wait_term, e == EACCES);
+    }
+
+    if (logged)
+        report("found tty %s", path ? path : term);
+
+    if (tty_fd < 0)
+        die("can't open tty '%s'", term);
+
+    why = tty_setup(path, speed, 1);
+    if (why) {
+        if (!strcmp(why, "isatty"))
+            die("%s is not a tty", term);
+        die("%s on %s", why, term);
+    }
+
+    return tty_fd;
+}
+
+
+/*
+ * the stall watchdog
+ */
+
+int tty_watch;
+
+static struct {
+    struct timespec last_data;
+    int armed;                          /* heartbeats seen since open */
+    int have_icount;
+    struct serial_icounter_struct open_ic;  /* at open */
+    struct serial_icounter_struct win_ic;   /* at start of this window */
+    struct serial_icounter_struct ic;       /* latest */
+    time_t win_start;
+} watch;
+
+/* totals, kept across reopens */
+static struct {
+    unsigned long frame, overrun, parity, brk, buf_overrun;
+    unsigned long stalls, degraded;
+} tty_totals;
+
+#define IC_ERRS(ic) ((ic).frame + (ic).overrun + (ic).parity + \
+                        (ic).brk + (ic).buf_overrun)
+
+static void
+tty_watch_start(void)
+{
+    memset(&watch, 0, sizeof(watch));
+    clock_gettime(CLOCK_MONOTONIC, &watch.last_data);
+    watch.win_start = watch.last_data.tv_sec;
+    if (ioctl(tty_fd, TIOCGICOUNT, &watch.open_ic) == 0) {
+        watch.have_icount = 1;
+        watch.win_ic = watch.ic = watch.open_ic;
+    }
+}
+
+/* fold this open's error counts into the totals */
+static void
+tty_watch_end(void)
+{
+    if (!watch.have_icount)
+        return;
+    tty_totals.frame += watch.ic.frame - watch.open_ic.frame;
+    tty_totals.overrun += watch.ic.overrun - watch.open_ic.overrun;
+    tty_totals.parity += watch.ic.parity - watch.open_ic.parity;
+    tty_totals.brk += watch.ic.brk - watch.open_ic.brk;
+    tty_totals.buf_overrun += watch.ic.buf_overrun - watch.open_ic.buf_overrun;
+    watch.have_icount = 0;
+}
+
+/*
+ * wait for the tty to become readable, a second at a time, checking
+ * for trouble in between.  returns 1 when there's something to read,
+ * or 0 if the device has stalled or its link has gone bad.
+ */
+static int
+tty_watchdog(framer_t *f)
+{
+    struct pollfd pfd;
+    struct timespec now;
+    int errs, r;
+
+    if (!watch.armed && f->heartbeats) {
+        report("tty: device heartbeat seen, stall watchdog armed");
+        watch.armed = 1;
+    }
+
+    pfd.fd = tty_fd;
+    pfd.events = POLLIN;
+
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        if (watch.have_icount && now.tv_sec - watch.win_start >= tty_watch) {
+            ioctl(tty_fd, TIOCGICOUNT, &watch.ic);
+            errs = IC_ERRS(watch.ic) - IC_ERRS(watch.win_ic);
+            watch.win_ic = watch.ic;
+            watch.win_start = now.tv_sec;
+            if (errs > TTY_MAX_ERRS) {
+                report("tty: %d line errors in %d seconds", errs, tty_watch);
+                tty_totals.degraded++;
+                tty_watch_end();
+                return 0;
+            }
+        }
+
+        if (watch.armed && now.tv_sec - watch.last_data.tv_sec >= tty_watch) {
+            report("tty: no data or heartbeat for %d seconds", tty_watch);
+            tty_totals.stalls++;
+            tty_watch_end();
+            return 0;
+        }
+
+        r = poll(&pfd, 1, 1000);
+        if (r < 0 && errno == EINTR)
+            return -1;  /* let the caller see to the signal */
+        if (r != 0)
+            return 1;   /* let read() sort it out */
+    }
+}
+
+void
+tty_stats(void)
+{
+    unsigned long frame, overrun, parity, brk, buf_overrun;
+
+    frame = tty_totals.frame;
+    overrun = tty_totals.overrun;
+    parity = tty_totals.parity;
+    brk = tty_totals.brk;
+    buf_overrun = tty_totals.buf_overrun;
+
+    if (watch.have_icount) {
+        ioctl(tty_fd, TIOCGICOUNT, &watch.ic);
+        frame += watch.ic.frame - watch.open_ic.frame;
+        overrun += watch.ic.overrun - watch.open_ic.overrun;
+        parity += watch.ic.parity - watch.open_ic.parity;
+        brk += watch.ic.brk - watch.open_ic.brk;
+        buf_overrun += watch.ic.buf_overrun - watch.open_ic.buf_overrun;
+    }
+
+    report("tty errors: frame %lu, overrun %lu, parity %lu, break %lu, "
+            "buffer overrun %lu; stalls %lu, degraded %lu",
+            frame, overrun, parity, brk, buf_overrun,
+            tty_totals.stalls, tty_totals.degraded);
+}
+
+
+/*
+ * network destinations
+ */
+
+void
+dest_init(dest_t *d, char *host, int port, int tcp)
+{
+    memset(d, 0, sizeof(*d));
+    d->host = host;
+    d->port = port;
+    d->tcp = tcp;
+    d->fd = -1;
+}
+
+static int
+dest_resolve(dest_t *d)
+{
+    struct hostent *hent;
+    struct sockaddr_in *sin = (struct sockaddr_in *)&d->sa;
+    struct sockaddr_un *sun = (struct sockaddr_un *)&d->sa;
+    char *path;
+
+    memset(&d->sa, 0, sizeof(d->sa));
+
+    if (!strncmp(d->host, DEST_UNIX_PREFIX, strlen(DEST_UNIX_PREFIX))) {
+        path = d->host + strlen(DEST_UNIX_PREFIX);
+        if (!*path || strlen(path) >= sizeof(sun->sun_path)) {
+            report("bad unix socket path '%s'", path);
+            return -1;
+        }
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, path);
+        d->salen = sizeof(*sun);
+    } else {
+        hent = gethostbyname(d->host);
+        if (!hent) {
+            report("gethostbyname failed for %s", d->host);
+            return -1;
+        }
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(d->port);
+        sin->sin_addr = *((struct in_addr *)hent->h_addr);
+        d->salen = sizeof(*sin);
+    }
+
+    d->resolved = 1;
+    return 0;
+}
+
+static int
+dest_connect(dest_t *d)
+{
+    time_t now;
+    int s;
+
+    /* don't hammer the resolver, or a dead peer, on every word */
+    now = time(0);
+    if (d->last_try && now - d->last_try < DEST_RETRY_SECS)
+        return -1;
+    d->last_try = now;
+
+    if (!d->resolved && dest_resolve(d) < 0)
+        return -1;
+
+    if ((s = socket(d->sa.ss_family,
+                    d->tcp ? SOCK_STREAM : SOCK_DGRAM, 0)) < 0)
+        die("%s socket open", d->tcp ? "stream" : "datagram");
+
+    if (connect(s, (struct sockaddr *)&d->sa, d->salen) < 0) {
+        if (d->sa.ss_family == AF_UNIX)
+            report("connect failed to %s", d->host);
+        else
+            report("connect failed to %s:%d", d->host, d->port);
+        close(s);
+        return -1;
+    }
+
+    d->fd = s;
+    return s;
+}
+
+void
+dest_close(dest_t *d)
+{
+    if (d->fd >= 0)
+        close(d->fd);
+    d->fd = -1;
+}
+
+/*
+ * returns the number of bytes sent, 0 if there's currently no
+ * connection, or -1 if the write failed.  in that last case the
+ * connection is closed (to be retried later) and errno is left
+ * for the caller to judge.
+ *
+ * on a stream, everything must go out, or the far end loses its
+ * place in the framing -- so a short send, or one cut off by a
+ * signal, is just carried on with.
+ *
+ * unlike udp, a unix datagram socket blocks when the receiver's
+ * queue is full, which would stall the tty reader behind a stuck
+ * lircd or relay.  so those sends don't wait:  a datagram that
+ * doesn't fit is counted as dropped, and 0 is returned.
+ */
+int
+dest_send(dest_t *d, const void *buf, int len)
+{
+    const char *p = buf;
+    int n, e, sent = 0, flags = MSG_NOSIGNAL;
+
+    if (d->fd < 0 && dest_connect(d) < 0)
+        return 0;
+
+    if (!d->tcp && d->sa.ss_family == AF_UNIX)
+        flags |= MSG_DONTWAIT;
+
+    while (sent < len) {
+        /* a stream whose far end has closed would otherwise kill
+         * us with SIGPIPE, rather than just failing */
+        n = send(d->fd, p + sent, len - sent, flags);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if ((flags & MSG_DONTWAIT) &&
+                    (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (d->drops++ % 1000 == 0)
+                    report("%s isn't keeping up, %lu datagram%s dropped",
+                            d->host, d->drops, d->drops == 1 ? "" : "s");
+                return 0;
+            }
+            e = errno;
+            dest_close(d);
+            errno = e;
+            return -1;
+        }
+        sent += n;
+    }
+    return sent;
+}
+
+
+/*
+ * the framer
+ *
+ * if we somehow start our reads "halfway" through one of the 16 bit
+ * data words, or lose or gain a byte along the way, we'll be out of
+ * sync.  we notice this because the 16 bit values that we read should
+ * have alternating high bits:  0x8000, 0x0000, 0x8000, etc.
+ *
+ * but two words in a row with the same high bit might also just be
+ * one corrupted byte, with the alignment still fine -- in which case
+ * blindly sliding by a byte makes things worse, and costs a second
+ * correction to get back.  so instead, we hold on to the bytes from
+ * the bad word onward, until we have FRAMER_WINDOW of them (or have
+ * seen enough to be sure, or the input goes quiet), and score both
+ * possible alignments over that window:  alternating high bits and
+ * 0x0000 escapes count for an alignment, zero-length and absurdly
+ * long pulses count against it.  then we commit to the better one,
+ * dropping the odd byte if need be, and any words that still don't
+ * fit.  everything discarded is counted.
+ *
+ * if resyncs keep coming, with fewer than FRAMER_GOOD_RUN good
+ * words between them, something's badly wrong, and we tell the
+ * caller, which reports it and starts over with framer_reset().
+ */
+
+void
+framer_reset(framer_t *f)
+{
+    f->have_byte = 0;
+    f->prevhigh = -1;
+    f->in_oob = 0;
+    f->phase_errs = 0;
+    f->good_run = 0;
+    f->resyncing = 0;
+    f->rlen = 0;
+}
+
+void
+framer_init(framer_t *f, framer_fn word, framer_fn oob, void *arg)
+{
+    memset(f, 0, sizeof(*f));
+    f->word = word;
+    f->oob = oob;
+    f->arg = arg;
+    f->stamp_lo = -1;
+    f->clock_ratio = f->scale = f->reported = 1.0;
+    framer_reset(f);
+}
+
+/* start the clock measurement over, from this stamp */
+static void
+framer_clock_restart(framer_t *f)
+{
+    f->anchor[0] = f->anchor[1] = f->stamp;
+    f->anchor_usec[0] = f->anchor_usec[1] = f->stamp_usec;
+}
+
+/*
+ * a timestamp from the device.  only its low 24 bits are sent, so
+ * fill in the rest from where the last one, and our own clock, say
+ * it should be.  then see how the device's clock compares to ours.
+ */
+static void
+framer_clock(framer_t *f, long stamp24)
+{
+    long long now = f->read_usec, dt, pred, stamp;
+    long diff;
+    double ratio;
+
+    if (!f->stamps++) {
+        f->stamp = stamp24;
+        f->stamp_usec = now;
+        framer_clock_restart(f);
+        return;
+    }
+
+    dt = now - f->stamp_usec;
+    pred = f->stamp + dt * STAMP_HZ / 1000000;
+    diff = (stamp24 - pred) & 0xffffff;
+    if (diff >= 0x800000)
+        diff -= 0x1000000;
+    stamp = pred + diff;
+
+    /* a reset device, or one we haven't heard from in ages */
+    if (stamp < f->stamp || dt > 0x400000LL * 1000000 / STAMP_HZ ||
+            (dt > 1000000 && fabs((stamp - f->stamp) * 1e6 /
+                    STAMP_HZ / dt - 1) > CLOCK_MAX_ERR)) {
+        f->stamp = stamp24;
+        f->stamp_usec = now;
+        framer_clock_restart(f);
+        return;
+    }
+    f->stamp = stamp;
+    f->stamp_usec = now;
+
+    if (now - f->anchor_usec[1] >= CLOCK_WINDOW * 1000000LL) {
+        f->anchor[0] = f->anchor[1];
+        f->anchor_usec[0] = f->anchor_usec[1];
+        f->anchor[1] = stamp;
+        f->anchor_usec[1] = now;
+    }
+
+    dt = now - f->anchor_usec[0];
+    if (dt < CLOCK_MIN_SECS * 1000000LL)
+        return;
+
+    ratio = (stamp - f->anchor[0]) * 1e6 / STAMP_HZ / dt;
+    if (fabs(ratio - 1) > CLOCK_MAX_ERR) {
+        framer_clock_restart(f);
+        return;
+    }
+    f->clock_ratio = ratio;
+    f->scale = (fabs(ratio - 1) < CLOCK_MIN_ERR) ? 1.0 : 1 / ratio;
+
+    if (fabs(ratio - f->reported) > CLOCK_REPORT) {
+        report("device clock is %+.2f%% off%s", (ratio - 1) * 100,
+                f->scale != 1.0 ? ", correcting durations" : "");
+        f->reported = ratio;
+    }
+}
+
+/* correct a duration for the device's clock.  0x7fff means "long". */
+static unsigned short
+framer_rescale(framer_t *f, unsigned short w)
+{
+    long d = w & 0x7fff;
+
+    if (d == 0x7fff)
+        return w;
+    d = lround(d * f->scale);
+    if (d < 1)
+        d = 1;
+    else if (d > 0x7ffe)
+        d = 0x7ffe;
+    return (w & 0x8000) | d;
+}
+
+/*
+ * deliver a word.  returns 1 if it's out of phase, in which case
+ * nothing was done with it.
+ */
+static int
+framer_word(framer_t *f, unsigned short w)
+{
+    int high;
+
+    if (f->in_oob) {
+        f->in_oob = 0;
+        f->oobs++;
+        switch (w & OOB_TYPE_MASK) {
+        case OOB_HEARTBEAT:
+            f->heartbeats++;
+            break;
+        case OOB_TIME_LO:
+            f->stamp_lo = w & 0xfff;
+            break;
+        case OOB_TIME_HI:
+            if (f->stamp_lo >= 0)
+                framer_clock(f, ((w & 0xfff) << 12) | f->stamp_lo);
+            f->stamp_lo = -1;
+            break;
+        }
+        flightrec_add(FR_OOB, f->recid, w);
+        if (f->oob)
+            f->oob(f->arg, w);
+        return 0;
+    }
+
+    if (w == 0) {
+        f->in_oob = 1;
+        f->prevhigh = -1;
+        return 0;
+    }
+
+    high = w & 0x8000;
+    if (high == f->prevhigh)
+        return 1;
+    f->prevhigh = high;
+
+    if (f->phase_errs && ++f->good_run >= FRAMER_GOOD_RUN)
+        f->phase_errs = f->good_run = 0;
+
+    f->words++;
+    flightrec_add(FR_WORD, f->recid, w);
+    if (f->scale != 1.0)
+        w = framer_rescale(f, w);
+    f->word(f->arg, w);
+    return 0;
+}
+
+/* how believable is the window, read with the given alignment? */
+static int
+framer_score(framer_t *f, int align)
+{
+    int i, score = 0, prevhigh, in_oob = 0;
+    unsigned short w;
+    int high;
+
+    /* the last good word only tells us about the current alignment */
+    prevhigh = align ? -1 : f->prevhigh;
+
+    for (i = align; i + 1 < f->rlen; i += 2) {
+        w = f->rbuf[i] | (f->rbuf[i + 1] << 8);
+        if (in_oob) {
+            in_oob = 0;
+            continue;
+        }
+        if (w == 0) {
+            score += 2;
+            in_oob = 1;
+            prevhigh = -1;
+            continue;
+        }
+        high = w & 0x8000;
+        if (prevhigh != -1)
+            score += (high != prevhigh) ? 2 : -3;
+        if ((w & 0x7fff) == 0)
+            score -= 3;         /* the device never sends these */
+        else if (high && (w & 0x7fff) > FRAMER_LONG_PULSE && w != 0xffff)
+            score -= 1;
+        prevhigh = high;
+    }
+    return score;
+}
+
+/*
+ * pick an alignment for the held bytes, and deliver what we can.
+ * returns -1 if we've had to do this too often.
+ */
+static int
+framer_commit(framer_t *f)
+{
+    int align, i, lost = 0;
+    unsigned short w;
+
+    align = framer_score(f, 1) > framer_score(f, 0);
+
+    f->resyncing = 0;
+    f->bytes_dropped += align;
+    if (align)
+        f->prevhigh = -1;
+    for (i = align; i + 1 < f->rlen; i += 2) {
+        w = f->rbuf[i] | (f->rbuf[i + 1] << 8);
+        if (framer_word(f, w)) {
+            /* still doesn't fit.  drop it, and take its high bit
+             * as the new reference, so the word after it goes too,
+             * and pulses and spaces still alternate downstream. */
+            f->prevhigh = w & 0x8000;
+            flightrec_add(FR_DROP, f->recid, w);
+            lost++;
+        }
+    }
+    f->words_dropped += lost;
+
+    f->have_byte = (i < f->rlen);
+    if (f->have_byte)
+        f->byte = f->rbuf[i];
+    f->rlen = 0;
+
+    report("phase resync: %s, dropped %d byte%s and %d word%s",
+            align ? "realigned" : "alignment kept",
+            align, align == 1 ? "" : "s", lost, lost == 1 ? "" : "s");
+    flightrec_add(FR_RESYNC, f->recid, align);
+    f->dump_due = 1;
+
+    if (++f->phase_errs > FRAMER_MAX_PHASE)
+        return -1;
+    return 0;
+}
+
+/* a resync is worth a look at the recent history */
+static void
+framer_dump(framer_t *f)
+{
+    if (f->dump_due) {
+        f->dump_due = 0;
+        flightrec_request("phase resync", 1);
+    }
+}
+
+/* enough evidence yet to decide? */
+static int
+framer_decided(framer_t *f)
+{
+    int d;
+
+    if (f->rlen >= FRAMER_WINDOW)
+        return 1;
+    if (f->rlen < FRAMER_MIN_WINDOW)
+        return 0;
+    d = framer_score(f, 0) - framer_score(f, 1);
+    return d >= FRAMER_MARGIN || d <= -FRAMER_MARGIN;
+}
+
+/*
+ * feed bytes to the framer.  returns 0, or -1 if we've lost sync
+ * completely.
+ */
+int
+framer_push(framer_t *f, const unsigned char *buf, int n)
+{
+    const unsigned char *end = buf + n;
+    unsigned short w;
+
+    f->read_usec = flightrec_stamp();
+
+    while (buf < end) {
+        if (f->resyncing) {
+            f->rbuf[f->rlen++] = *buf++;
+            if (framer_decided(f) && framer_commit(f) < 0) {
+                framer_dump(f);
+                return -1;
+            }
+            continue;
+        }
+        if (!f->have_byte) {
+            f->byte = *buf++;
+            f->have_byte = 1;
+            continue;
+        }
+        w = (*buf << 8) | f->byte;
+        if (framer_word(f, w)) {
+            /* hold this word's bytes, and what follows */
+            f->phase_corrections++;
+            f->good_run = 0;
+            f->resyncing = 1;
+            f->rbuf[0] = f->byte;
+            f->rbuf[1] = *buf;
+            f->rlen = 2;
+        }
+        f->have_byte = 0;
+        buf++;
+    }
+
+    /* the rest of the read shows how the resync turned out */
+    framer_dump(f);
+    return 0;
+}
+
+/*
+ * the input has gone quiet.  if we're holding bytes for a resync,
+ * decide with what we have, rather than sit on the end of a burst.
+ */
+int
+framer_flush(framer_t *f)
+{
+    int r = 0;
+
+    if (f->resyncing)
+        r = framer_commit(f);
+    framer_dump(f);
+    return r;
+}
+
+void
+framer_stats(framer_t *f, char *name)
+{
+    report("%s: %lu words, %lu oob, %lu resyncs, "
+            "dropped %lu bytes and %lu words",
+            name, f->words, f->oobs, f->phase_corrections,
+            f->bytes_dropped, f->words_dropped);
+    if (f->stamps)
+        report("%s: %d timestamps, device clock %+.3f%% off%s", name,
+                f->stamps, (f->clock_ratio - 1) * 100,
+                f->scale != 1.0 ? " (corrected)" : "");
+}
+
+/*
+ * read whatever's available (at least VMIN bytes) from the tty, and
+ * frame it.  returns the count of bytes read, or FRAMER_EOF,
+ * FRAMER_ERR, FRAMER_LOST, or FRAMER_STALL.
+ */
+int
+framer_read(framer_t *f, int fd)
+{
+    unsigned char buf[FRAMER_BUFSIZE];
+    int n, r, size = sizeof(buf);
+    struct pollfd pfd;
+
+    /* don't hold a resync window open across a quiet spell.  this
+     * comes before the watchdog, which would otherwise sit through
+     * the whole spell. */
+    if (f->resyncing) {
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        r = poll(&pfd, 1, FRAMER_IDLE_MS);
+        if (r < 0 && errno == EINTR)
+            return FRAMER_ERR;
+        if (r == 0 && framer_flush(f) < 0)
+            return FRAMER_LOST;
+    }
+
+    if (fd == tty_fd) {
+        size = tty_readsize;
+        if (tty_watch) {
+            r = tty_watchdog(f);
+            if (r == 0)
+                return FRAMER_STALL;
+            if (r < 0)
+                return FRAMER_ERR;
+        }
+    }
+
+    n = read(fd, buf, size);
+    if (n <= 0)
+        return n;
+
+    if (fd == tty_fd && tty_watch)
+        clock_gettime(CLOCK_MONOTONIC, &watch.last_data);
+
+    if (fd == tty_fd && tune.active)
+        tty_observe(n);
+
+    if (framer_push(f, buf, n) < 0)
+        return FRAMER_LOST;
+
+    return n;
+}
@@ -0,0 +1,247 @@
+/*
+ * avrhost.h
+ *
+ * host-side support shared by avrlirc2udp and airboard-ir:  tty
+ * setup, network destinations, and the framer that turns the raw
+ * byte stream from an avrlirc device into 16 bit words.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef AVRHOST_H
+#define AVRHOST_H
+
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/* default port for reports to lircd */
+#define LIRCD_UDP_PORT 8765
+
+/* each program supplies its own versions of these */
+void report(const char *fmt, ...);
+void die(const char *fmt, ...);
+
+
+/*
+ * tty.  tty_init() also asks for low-latency delivery from the
+ * driver and adapter, and the first TUNE_READS reads through
+ * framer_read() are timed to pick the read size.
+ */
+#define TTY_LATENCY_MS 1        /* usb-serial latency_timer we want */
+#define TTY_READSIZE 256        /* initial read size */
+#define TUNE_READS 200
+#define TUNE_BURST_GAP 50000    /* usec -- longer gaps are between bursts */
+
+/*
+ * the tty can be named by the serial number of its usb adapter, as
+ * "usb:<serial>".  while waiting for it (tty_init()'s wait_term),
+ * inotify wakes us as soon as anything changes on its path, with
+ * wait_term seconds becoming just the fallback poll interval.
+ */
+#define TTY_USB_PREFIX "usb:"
+#define TTY_BY_ID "/dev/serial/by-id"
+
+#define TTY_MAX_OPEN 8
+
+extern int tty_fd;
+extern int tty_readsize;
+
+int tty_init(char *term, int wait_term, int speed);
+int tty_try_open(char *term, int speed);
+void tty_restore(void);
+void tty_release(int fd);
+char *tty_resolve(char *term);
+
+/*
+ * if tty_fast_rate is set (to 76800, 250000 or 500000), tty_init() tries
+ * to move the device up to that rate, using its command interface.
+ * the rate switch is done with termios2, in ttyrate.c.
+ */
+#define TTY_BASE_RATE 38400
+#define HANDSHAKE_MS 300        /* how long we wait for each answer */
+extern int tty_fast_rate;
+
+int tty_set_rate(int fd, int rate);
+int tty_parse_rate(char *s);
+
+/*
+ * tty_calibrate() trims the device's internal oscillator, using its
+ * command interface, so it runs at its nominal rate (and so at its
+ * nominal FOSC).  the device times two characters we send CAL_GAP_MS
+ * apart, and steps OSCCAL, until it's within CAL_TOL (in hundredths
+ * of a percent).  since an untrimmed device may be too far off to
+ * hear us at first, we look for it within CAL_SCAN percent.  the
+ * result is saved in the device's eeprom, and checked with its 'U'
+ * loop.
+ */
+#define CAL_GAP_MS 1000         /* must match CAL_MS in avrlirc.c */
+#define CAL_TOL 40              /* ditto */
+#define CAL_ROUNDS 12
+#define CAL_SCAN 12
+#define CAL_SCAN_STEP 2
+#define CAL_VERIFY_BYTES 1024
+
+int tty_calibrate(char *term, int rate);
+
+/*
+ * the stall watchdog.  if tty_watch is set (in seconds), a device
+ * that has been sending heartbeats, but then goes silent for that
+ * long, is declared stalled.  so is one whose line error counts
+ * (from TIOCGICOUNT) grow by more than TTY_MAX_ERRS in that time.
+ * either way, framer_read() returns FRAMER_STALL, and the caller
+ * should reopen the tty.  tty_stats() reports the counters.
+ */
+#define TTY_MIN_WATCH 3         /* heartbeats come every ~2 seconds */
+#define TTY_MAX_ERRS 20
+extern int tty_watch;
+
+void tty_stats(void);
+
+
+/*
+ * network destinations.  the host is resolved once, and the
+ * connection is (re)made on demand, no more than once every
+ * DEST_RETRY_SECS.  a host of the form "unix:/some/path" names
+ * a local unix-domain socket instead, and the port is ignored.
+ */
+#define DEST_RETRY_SECS 1
+#define DEST_UNIX_PREFIX "unix:"
+
+typedef struct dest {
+    char *host;
+    int port;
+    int tcp;
+    int fd;
+    int resolved;
+    time_t last_try;
+    struct sockaddr_storage sa;
+    socklen_t salen;
+    unsigned long drops;        /* datagrams a full unix socket refused */
+} dest_t;
+
+void dest_init(dest_t *d, char *host, int port, int tcp);
+int dest_send(dest_t *d, const void *buf, int len);
+void dest_close(dest_t *d);
+
+
+/*
+ * out-of-band payloads from the device.  the top 4 bits are the
+ * record type.
+ */
+#define OOB_TYPE_MASK 0xf000
+#define OOB_HEARTBEAT 0x1000    /* low 12 bits:  sequence number */
+#define OOB_TIME_LO 0x2000      /* low 12 bits:  timestamp bits 0-11 */
+#define OOB_TIME_HI 0x3000      /* low 12 bits:  timestamp bits 12-23 */
+
+/*
+ * the device's timestamps (in the same 1/16384ths as its durations)
+ * are compared with CLOCK_MONOTONIC, to measure how far off its
+ * clock is.  the comparison spans between one and two CLOCK_WINDOWs,
+ * so it follows slow (temperature) drift.  once it's based on at
+ * least CLOCK_MIN_SECS, and the error is bigger than CLOCK_MIN_ERR,
+ * the framer rescales the durations it delivers.  an apparent error
+ * over CLOCK_MAX_ERR means the device was reset, or the stamps were
+ * garbled, and the measurement starts over.
+ */
+#define STAMP_HZ 16384
+#define CLOCK_WINDOW 120        /* seconds */
+#define CLOCK_MIN_SECS 10
+#define CLOCK_MIN_ERR 0.002
+#define CLOCK_MAX_ERR 0.15
+#define CLOCK_REPORT 0.005      /* report changes bigger than this */
+
+
+/*
+ * the framer.  bytes from the tty are pushed in, and complete
+ * words come out through the callbacks -- IR data through 'word',
+ * and the payload of out-of-band records (a 0x0000 word followed
+ * by one data word) through 'oob'.  alignment errors are fixed up
+ * along the way, and framer_flush() should be called when the input
+ * goes quiet (framer_read() does this itself).  the counts of
+ * resyncs, and of what they cost, are kept for framer_stats().
+ */
+typedef void (*framer_fn)(void *arg, unsigned short w);
+
+#define FRAMER_BUFSIZE 1024     /* most we'll read from the tty at once */
+#define FRAMER_MAX_PHASE 10     /* resyncs before we give up... */
+#define FRAMER_GOOD_RUN 100     /* ...unless this many good words between */
+
+/* resync:  bytes we hold to compare alignments over, the fewest we
+ * decide with early, and the score lead needed to do so.  a quiet
+ * spell of FRAMER_IDLE_MS also forces a decision. */
+#define FRAMER_WINDOW 24
+#define FRAMER_MIN_WINDOW 8
+#define FRAMER_MARGIN 8
+#define FRAMER_IDLE_MS 20
+#define FRAMER_LONG_PULSE 2048  /* 125ms -- no IR pulse is that long */
+
+/* framer_read() return values, besides the byte count */
+#define FRAMER_EOF   0          /* tty has gone away */
+#define FRAMER_ERR  -1          /* read failed, see errno (EINTR:  a
+                                   signal arrived, just try again) */
+#define FRAMER_LOST -2          /* hopelessly out of phase */
+#define FRAMER_STALL -3         /* watchdog fired, see tty_watch */
+
+typedef struct framer {
+    framer_fn word;
+    framer_fn oob;
+    void *arg;
+    int recid;                  /* receiver, for the flight recorder */
+
+    /* private */
+    int have_byte;
+    unsigned char byte;
+    int prevhigh;
+    int in_oob;
+    int phase_errs;
+    int good_run;
+    int resyncing;
+    int dump_due;               /* flight recorder, after a resync */
+    unsigned char rbuf[FRAMER_WINDOW];
+    int rlen;
+
+    /* device clock measurement */
+    unsigned long long read_usec;       /* time of the current read */
+    int stamp_lo;                       /* -1 if none pending */
+    int stamps;
+    long long stamp, stamp_usec;        /* the latest, unwrapped */
+    long long anchor[2], anchor_usec[2];
+    double clock_ratio;                 /* device seconds per real one */
+    double scale;                       /* what we apply to durations */
+    double reported;
+
+    /* statistics */
+    unsigned long words;
+    unsigned long oobs;
+    unsigned long heartbeats;
+    unsigned long phase_corrections;    /* resyncs */
+    unsigned long bytes_dropped;
+    unsigned long words_dropped;
+} framer_t;
+
+void framer_init(framer_t *f, framer_fn word, framer_fn oob, void *arg);
+void framer_reset(framer_t *f);
+int framer_push(framer_t *f, const unsigned char *buf, int n);
+int framer_flush(framer_t *f);
+void framer_stats(framer_t *f, char *name);
+int framer_read(framer_t *f, int fd);
+
+#endif /* AVRHOST_H */
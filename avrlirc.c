@@ -42,6 +42,17 @@
  * baud exclusively, which lets me dispense with the crystal, the caps,
  * and also means that the chip's fuse settings don't need to be changed.
  *
+ * on the other hand, at 8Mhz the double-speed (U2X) UART mode divides
+ * exactly down to 250000 and 500000 baud, so with the internal
+ * oscillator, the host can ask for those rates (see set_baud(),
+ * below).  the software inverter can't keep up at those speeds, so
+ * they're only usable when txd (pin 3) is wired directly to a TTL
+ * level serial adapter, as with most USB-serial cables.  76800 (also
+ * nearly exact at 8Mhz) does work through the inverter -- see the
+ * comments at PCINT_vect for its timing.  115200 isn't offered:  the
+ * nearest 8Mhz divisor is 3.5% off, which is too much on top of the
+ * inverter's jitter.
+ *
  * the IR receiver should be something like the Vishay TSOP3438 (2.5V
  * to 5.5V) or the Sharp GP1UX511QS (5V only).
  *
@@ -98,8 +109,9 @@
  *       with a minimum value of 1.  since transmit data is buffered,
  *       baud rates slower than the pulse arrival rate are tolerated.
  *       two zero bytes in a row (which can't occur otherwise) are
- *       reserved as an escape mechanism for someday sending other
- *       types of data.
+ *       an escape mechanism for sending other types of data:  the
+ *       next word is an out-of-band record:  a periodic heartbeat,
+ *       while the IR line is quiet, or a timestamp.
  *   - ascii mode is a simple command/response, for debugging.  requires
  *       max232 or equiv. line driver -- don't connect the RS232 TX
  *       signal directly to your AVR!!!  enable the ability to run
@@ -146,6 +158,7 @@
 #include <avr/pgmspace.h>
 #include <avr/sleep.h>
 #include <avr/wdt.h>
+#include <avr/eeprom.h>
 
 /*
  * fuses:    default for tiny2313: low 0x64 high 0xdf 
@@ -168,6 +181,21 @@ typedef uint8_t byte;
  */
 #define DO_RECEIVE 1
 
+/* timestamps let the host measure our clock against its own, and
+ * correct our durations for an untrimmed RC oscillator.  they cost
+ * about 200 bytes, and 8 bytes of serial data every couple of
+ * seconds, and at the start of each burst.
+ */
+#define DO_TIMESTAMPS 1
+
+/* oscillator calibration, driven by the host (see cal_check(), and
+ * "avrlirc2udp -C").  it needs the command interface, and timer1's
+ * running count from the timestamp code.  about 250 bytes.
+ */
+#if DO_RECEIVE && DO_TIMESTAMPS
+# define DO_CALIBRATE 1
+#endif
+
 /* if connecting to the console RX/TX on a $9 CHIP computer, there's a
  * risk that an IR sequence will cause data to be received on the
  * computer console while it's booting, thereby halting the boot
@@ -184,6 +212,7 @@ typedef uint8_t byte;
  */
 // #define FOSC 3686400		// STK500, ext. clock, for example
 // #define FOSC 7372800		// with crystal, or int. RC w/ OSCCAL recal.
+					// (see DO_CALIBRATE)
 #define FOSC 8000000		// 38.4Kbaud) (internal osc)
 // #define FOSC 12000000
 // #define FOSC 11059200
@@ -240,16 +269,66 @@ typedef uint8_t byte;
     void vector (void) __attribute__((interrupt)); \
     void vector (void)
 
+/* and one with no prologue or epilogue at all, for handlers written
+ * entirely in asm.  they must save what they use, and end in reti.
+ */
+#define NAKED_ISR(vector)  \
+    void vector (void) __attribute__((signal, naked)); \
+    void vector (void)
+
 volatile word pulse_length;
 volatile byte pulse_is_high;
 volatile byte had_overflow;
 
+/*
+ * out-of-band records are a zero word followed by one payload word.
+ * the top 4 bits of the payload say what it is.  a heartbeat is
+ * sent every timer1 overflow (i.e., every 2 seconds of IR silence),
+ * so the host can tell a quiet receiver from a dead one.
+ */
+#define OOB_HEARTBEAT	0x1000	// low 12 bits:  sequence number
+volatile byte heartbeat_due;
+word heartbeat_seq;
+
+#if DO_TIMESTAMPS
+/*
+ * a timestamp is the time since reset, in the same 1/16384ths of a
+ * second as the pulse data, sent as two records:  its low 12 bits,
+ * then the next 12.  (the host fills in the rest.)  one goes with
+ * each heartbeat, and one follows the first word of each burst,
+ * giving the time of the edge that started it.
+ *
+ * timer1 is restarted at every capture, so we keep its raw count
+ * ourselves:  ticks_base is the count as of the last restart or
+ * overflow, and TCNT1 has the rest.  the restart comes a little
+ * after the capture, and whenever a tick lands in between, it would
+ * be lost -- a small but steady bias, growing with the number of
+ * edges, that would make the device's clock look slow.  so it's
+ * the count at the restart, not the capture, that's added in.
+ */
+#define OOB_TIME_LO	0x2000	// low 12 bits:  timestamp bits 0-11
+#define OOB_TIME_HI	0x3000	// low 12 bits:  timestamp bits 12-23
+volatile uint32_t ticks_base;
+volatile uint32_t edge_ticks;	// ticks_base as of the last capture
+uint32_t stamp_ticks;		// raw count converted so far...
+uint32_t stamp;			// ...and what it came to
+word stamp_rem;
+#endif
+
 static const char version_s[] PROGMEM = AVRLIRC_VERSION;
 static const char fox_s[] PROGMEM = "The Quick Brown Fox Jumped Over the Lazy Dog's Back\r\n";
 
+#if FOSC == 8000000 && DO_RECEIVE
+# define HIGH_BAUD 1
+#endif
+
 #if DO_RECEIVE
 static const char error_s[] PROGMEM = "try (h)elp";
-static const char usage_s[] PROGMEM = "(a)scii (b)inary (i)r (v)ers (f)ox (m)cuusr (U)UUU";
+#if HIGH_BAUD
+static const char usage_s[] PROGMEM = "(a)scii (b)inary (i)r (v)ers (f)ox (m)cuusr (U)UUU (c)al (C)save baud:(0)38400 (7)6800 (2)50k (5)00k";
+#else
+static const char usage_s[] PROGMEM = "(a)scii (b)inary (i)r (v)ers (f)ox (m)cuusr (U)UUU (c)al (C)save";
+#endif
 static const char ascii_s[] PROGMEM = "ascii";
 static const char binary_s[] PROGMEM = "binary";
 static const char crnl_s[] PROGMEM = "\r\n";
@@ -264,6 +343,63 @@ volatile byte tx_queue[TX_QLEN];
 
 volatile byte mcusr_mirror;
 
+#if DO_CALIBRATE
+/*
+ * oscillator calibration.  there's no capture input on rxd, so
+ * rather than timing a pattern's bits, the host sends 'c', and then
+ * two characters exactly CAL_MS apart by its own clock.  we time
+ * the gap with timer1, and step OSCCAL toward the right speed.
+ * there's some USB jitter in the host's timing, but over a whole
+ * second, it's well under one OSCCAL step.
+ *
+ * the answer is "cal <osccal> <error>", both in hex, the error
+ * being what we measured before the adjustment, in hundredths of a
+ * percent (signed).  the host repeats this until we're within
+ * CAL_TOL, then sends 'C' to save OSCCAL in the eeprom, where
+ * hw_init() will find it at every reset.
+ */
+#define CAL_MS		1000
+#define CAL_TOL		40	// 0.40% -- about half an OSCCAL step
+#define CAL_PER_STEP	70	// roughly, 0.7% per OSCCAL step
+#define CAL_MAX_STEP	16
+#define CAL_MAGIC	0xa5
+#define EE_CAL_MAGIC	((uint8_t *)0)
+#define EE_CAL_OSCCAL	((uint8_t *)1)
+
+#define CAL_IDLE	0
+#define CAL_START	1	// next character starts the clock
+#define CAL_STOP	2	// ...and the one after stops it
+#define CAL_DONE	3	// for cal_check()
+volatile byte cal_state;
+volatile uint32_t cal_ticks;
+
+static const char cal_s[] PROGMEM = "cal";
+static const char saved_s[] PROGMEM = "saved";
+#endif
+
+#if HIGH_BAUD
+/*
+ * baud rate switching.  the host sends '7', '2' or '5' (or '0' to
+ * come back down to 38400).  we answer at the current rate, then switch
+ * once that answer has left the UART.  the new rate is "unconfirmed"
+ * until the host sends us something we can receive cleanly at that
+ * rate -- if it never does, the next timer1 overflow (i.e., 2 seconds
+ * of IR silence) puts us back at 38400, so a host that has lost track
+ * of us can always start over there.
+ */
+#define BAUD_38400  0
+#define BAUD_250000 1
+#define BAUD_500000 2
+#define BAUD_76800  3
+static const char baud_0_s[] PROGMEM = "38400";
+static const char baud_7_s[] PROGMEM = "76800";
+static const char baud_2_s[] PROGMEM = "250000";
+static const char baud_5_s[] PROGMEM = "500000";
+volatile byte baud_cur;
+volatile byte baud_want;
+volatile byte baud_unconfirmed;
+#endif
+
 // verify the crystal freq. config
 #if FOSC != 14745600 && FOSC != 12000000 && \
     FOSC != 11059200 && FOSC !=  8000000 && \
@@ -286,6 +422,12 @@ hw_init(void)
     CLKPR = bit(CLKPCE);
     CLKPR = 0;
 
+#if DO_CALIBRATE
+    // use our saved oscillator calibration, if there is one
+    if (eeprom_read_byte(EE_CAL_MAGIC) == CAL_MAGIC)
+	OSCCAL = eeprom_read_byte(EE_CAL_OSCCAL);
+#endif
+
 
     // setup outputs and pullups
 
@@ -329,6 +471,7 @@ hw_init(void)
     UBRRL = 12;		// for 38400 baud at 8Mhz
     // UBRRL = 51;		// for 19200 baud at 8Mhz,
     // UCSRA |= bit(U2X);	//  needs doubletime
+    // (and see set_baud() for 250000 and 500000)
 #elif FOSC == 7372800
     UBRRL = 3;		// for 115200 baud at 7.3728Mhz, or detuned 8Mz
 #elif FOSC == 3686400
@@ -411,14 +554,18 @@ tx_char(byte t)
 
     tmp = (tx_w + 1) & TX_QLEN_MASK;
 
-#define WAIT_FOR_TX_SPACE 1 // tx_char() only called with ints enabled
+#define WAIT_FOR_TX_SPACE 1
 #if WAIT_FOR_TX_SPACE
-    // if we were to call tx_char() with interrupts disabled,
-    // this condition will never be met.  in that case, we could
-    // probably still make it work, but it's probably not worth
-    // it.
-    while (tmp == tx_r)
-	/* spin for freespace */;
+    // with interrupts disabled (replies from USART_RX), the UDRE
+    // handler can't make room for us, so do its job here.  the
+    // inverter can't run meanwhile, but only the help text is
+    // long enough to get here.
+    while (tmp == tx_r) {
+	if (!(SREG & bit(SREG_I)) && (UCSRA & bit(UDRE))) {
+	    tx_r = (tx_r + 1) & TX_QLEN_MASK;
+	    UDR = tx_queue[tx_r];
+	}
+    }
 #else
     if (tmp == tx_r) {
 	return;  // drop character
@@ -484,6 +631,61 @@ tx_word(word t)
     tx_char((t >> 8) & 0xff);
 }
 
+/*
+ * tx_heartbeat - tell the host we're still alive
+ */
+void
+tx_heartbeat(void)
+{
+    heartbeat_due = 0;
+#if DO_RECEIVE
+    if (ascii)
+	return;
+#endif
+    tx_word(0);
+    tx_word(OOB_HEARTBEAT | (heartbeat_seq++ & 0x0fff));
+}
+
+#if DO_TIMESTAMPS
+/*
+ * the raw timer1 count right now.  if timer1 has just wrapped, but
+ * we've beaten the overflow handler here, account for it.
+ */
+uint32_t
+now_ticks(void)
+{
+    uint32_t t;
+    word tcnt;
+    byte sreg = SREG;	// we're called with interrupts off, too
+
+    cli();
+    tcnt = TCNT1;
+    t = ticks_base + tcnt;
+    if ((TIFR & bit(TOV1)) && tcnt < 0x8000)
+	t += 0x10000;
+    SREG = sreg;
+    return t;
+}
+
+#endif
+
+#if DO_CALIBRATE
+/* the eeprom's write sequence mustn't be interrupted, but we
+ * needn't hold interrupts off while it finishes a previous write.
+ * (called from USART_RX, so leave them as we found them.) */
+void
+ee_write(uint8_t *addr, byte val)
+{
+    byte sreg;
+
+    eeprom_busy_wait();
+    sreg = SREG;
+    cli();
+    eeprom_write_byte(addr, val);
+    SREG = sreg;
+}
+#endif
+
 void
 UUUU_loop()
 {
@@ -495,9 +697,66 @@ UUUU_loop()
 	wdt_reset();
 	tx_char('U');  /* square wave */
 	Led2_Flip();
+#if DO_CALIBRATE
+	/* the host checks our calibration this way, and then
+	 * needs us back.  any character ends the loop. */
+	if (UCSRA & bit(RXC)) {
+	    (void)UDR;
+	    break;
+	}
+#endif
     }
+    while (tx_r != tx_w)
+	wdt_reset();
+    UCSRC |= bit(USBS);
 }
 
+#if HIGH_BAUD
+/*
+ * switch the UART to one of our four rates.  at 8Mhz:
+ *  38400:  UBRR 12, normal speed (+0.2%)
+ *  76800:  UBRR 12, U2X (+0.2%)
+ *  250000: UBRR 3, U2X (exact)
+ *  500000: UBRR 1, U2X (exact)
+ */
+void
+set_baud(byte which)
+{
+    cli();
+    if (which == BAUD_38400) {
+	UCSRA &= ~bit(U2X);
+	UBRRL = 12;
+    } else {
+	UCSRA |= bit(U2X);
+	if (which == BAUD_76800)
+	    UBRRL = 12;
+	else
+	    UBRRL = (which == BAUD_250000) ? 3 : 1;
+    }
+    baud_cur = which;
+    sei();
+}
+
+/*
+ * called from the main loop.  if the host has asked for a new rate,
+ * wait for our reply to drain completely, then switch.
+ */
+void
+baud_check(void)
+{
+    if (baud_want == baud_cur)
+	return;
+
+    // TXC is cleared when the reply is queued, and gets set once
+    // the shift register empties with nothing more to send.
+    while (tx_r != tx_w || !(UCSRA & bit(TXC)))
+	wdt_reset();
+
+    set_baud(baud_want);
+    baud_unconfirmed = (baud_want != BAUD_38400);
+}
+#endif
+
 /*
  * timer1 overflow interrupt handler.
  * if we hit the overflow without getting a transition on the IR
@@ -514,6 +773,23 @@ INTERRUPTIBLE_ISR(TIMER1_OVF_vect)
     else
 	tmp = 0x7f;
     had_overflow = tmp;
+    heartbeat_due = 1;
+
+#if DO_TIMESTAMPS
+    // a capture could interrupt us otherwise
+    cli();
+    ticks_base += 0x10000;
+    sei();
+#endif
+
+#if HIGH_BAUD
+    // nobody's spoken to us at the new rate.  give up on it.
+    if (baud_unconfirmed) {
+	baud_unconfirmed = 0;
+	baud_want = BAUD_38400;
+	set_baud(BAUD_38400);
+    }
+#endif
 }
 
 /*
@@ -536,6 +812,9 @@ INTERRUPTIBLE_ISR(TIMER1_COMPA_vect)
  */
 INTERRUPTIBLE_ISR(TIMER1_CAPT_vect)
 {
+#if DO_TIMESTAMPS
+    word tcnt;
+#endif
 
     // read the event
     pulse_length = ICR1;
@@ -543,8 +822,17 @@ INTERRUPTIBLE_ISR(TIMER1_CAPT_vect)
     pulse_is_high = IR_is_high();
 
     // restart the timer
+#if DO_TIMESTAMPS
+    tcnt = TCNT1;
+#endif
     TCNT1 = 0;
 
+#if DO_TIMESTAMPS
+    // (an overflow can't come along until long after this)
+    edge_ticks = ticks_base + pulse_length;
+    ticks_base += tcnt;
+#endif
+
 
     // change detection edge, and clear interrupt flag -- it's
     // set as result of detection edge change
@@ -556,20 +844,59 @@ INTERRUPTIBLE_ISR(TIMER1_CAPT_vect)
 }
 
 /*
- * uart transmit interrupt handler.
+ * uart transmit interrupt handler.  the C version of this was:
+ *
+ *	UCSRB &= ~bit(UDRIE);
+ *	sei();
+ *	if (tx_r != tx_w) {
+ *	    tx_r = (tx_r + 1) & TX_QLEN_MASK;
+ *	    UDR = tx_queue[tx_r];
+ *	    UCSRB |= bit(UDRIE);
+ *	}
+ *
+ * but the compiler's prologue pushed 8 registers before getting to
+ * the sei(), holding off the inverter (below) for over 20 cycles on
+ * every byte sent.  here, interrupts are back on 3 cycles in.
  */
-ISR(USART_UDRE_vect)
+NAKED_ISR(USART_UDRE_vect)
 {
-    // disable uart interrupt, so we can reenable interrupts in general
-    UCSRB &= ~bit(UDRIE);
-    sei();
-
-    // if data in queue, send it, and reenable the interrupt
-    if (tx_r != tx_w) {
-	tx_r = (tx_r + 1) & TX_QLEN_MASK;
-	UDR = tx_queue[tx_r];
-	UCSRB |= bit(UDRIE);
-    }
+    asm volatile(
+	"cbi	%[ucsrb], %[udrie]"	"\n\t"	// mask ourselves...
+	"sei"				"\n\t"	// ...and let the inverter in
+	"push	r24"			"\n\t"
+	"in	r24, __SREG__"		"\n\t"
+	"push	r24"			"\n\t"
+	"push	r25"			"\n\t"
+	"push	r30"			"\n\t"
+	"push	r31"			"\n\t"
+	"lds	r24, tx_r"		"\n\t"
+	"lds	r25, tx_w"		"\n\t"
+	"cp	r24, r25"		"\n\t"
+	"breq	1f"			"\n\t"	// queue empty
+	"inc	r24"			"\n\t"
+	"andi	r24, %[mask]"		"\n\t"
+	"sts	tx_r, r24"		"\n\t"
+	"mov	r30, r24"		"\n\t"
+	"ldi	r31, 0"			"\n\t"
+	"subi	r30, lo8(-(tx_queue))"	"\n\t"
+	"sbci	r31, hi8(-(tx_queue))"	"\n\t"
+	"ld	r24, Z"			"\n\t"
+	"out	%[udr], r24"		"\n\t"
+	"sbi	%[ucsrb], %[udrie]"	"\n"
+    "1:"					"\n\t"
+	"pop	r31"			"\n\t"
+	"pop	r30"			"\n\t"
+	"pop	r25"			"\n\t"
+	"pop	r24"			"\n\t"
+	"out	__SREG__, r24"		"\n\t"
+	"pop	r24"			"\n\t"
+	"reti"
+	:
+	: [ucsrb] "I" (_SFR_IO_ADDR(UCSRB)),
+	  [udr] "I" (_SFR_IO_ADDR(UDR)),
+	  [udrie] "I" (UDRIE),
+	  [mask] "M" (TX_QLEN_MASK)
+    );
 }
 
 /*
@@ -577,15 +904,55 @@ ISR(USART_UDRE_vect)
  * this is purely and simply an inversion function -- we want to
  * present an inverted copy of the USART's TX output to the host's
  * serial port.  so we watch for changes on one pin, and update the other.
- * since this operation needs minimal latency, we reenable interrupts
- * wherever possible in the other interrupt handlers.
+ *
+ * since every cycle of delay here shifts a bit edge, it's written
+ * in asm, with both paths taking the same time.  it touches neither
+ * registers nor SREG, so it needs no prologue at all.  counting from
+ * the pin change being latched:
+ *
+ *	4	interrupt response (push PC, to the vector)
+ *	2	rjmp from the vector table
+ *	5	sbis/rjmp/sbi, or sbis/nop/cbi -- the port changes
+ *	4	reti
+ *
+ * so the output always follows the input by 11 cycles (1.4us at
+ * 8Mhz), and we're gone again in 15.  if the input changes again
+ * between our read and our write, the pin change flag will have
+ * been set again, and we come straight back to fix it.
+ *
+ * on top of that fixed delay, the jitter comes from whatever else
+ * was going on:
+ *	+0..3	finishing the current instruction
+ *	+4	waking from sleep
+ *	+up to 11  another handler's entry, before its sei -- the
+ *		TIMER1 handlers (INTERRUPTIBLE_ISR) and UDRE (above)
+ *		all get there quickly.  USART_RX runs with interrupts
+ *		off throughout, but only when the host sends a command,
+ *		and the host isn't listening to IR data then.
+ *	+up to 15  the short cli() sections in emit_pulse_data() and
+ *		the main loop.
+ *
+ * call it 35 cycles, worst case, against 104 cycles per bit at
+ * 76800 baud:  the edge still lands well inside the bit, and the
+ * receiver samples at its middle.
  */
-ISR(PCINT_vect)
+NAKED_ISR(PCINT_vect)
 {
-    if (PINB & bit(TX_INVERT_IN))
-	PORTB &= ~bit(TX_INVERT_OUT);
-    else
-	PORTB |= bit(TX_INVERT_OUT);
+    asm volatile(
+	"sbis	%[pin], %[in]"		"\n\t"	// input low:  1 cycle
+	"rjmp	1f"			"\n\t"	//   2
+	"nop"				"\n\t"	// input high:  2 (skip), 1
+	"cbi	%[port], %[out]"	"\n\t"	//   2 -- out goes low
+	"reti"				"\n"
+    "1:"					"\n\t"
+	"sbi	%[port], %[out]"	"\n\t"	//   2 -- out goes high
+	"reti"
+	:
+	: [pin] "I" (_SFR_IO_ADDR(PINB)),
+	  [port] "I" (_SFR_IO_ADDR(PORTB)),
+	  [in] "I" (TX_INVERT_IN),
+	  [out] "I" (TX_INVERT_OUT)
+    );
 }
 
 
@@ -600,8 +967,33 @@ ISR(USART_RX_vect)
 
     Led2_Flip();
 
+#if HIGH_BAUD
+    // a cleanly received character confirms the current rate
+    if (!(UCSRA & bit(FE)))
+	baud_unconfirmed = 0;
+#endif
+
     c = UDR;
 
+#if DO_CALIBRATE
+    // timing a calibration gap?  the characters themselves don't matter.
+    if (cal_state == CAL_START) {
+	cal_ticks = now_ticks();
+	cal_state = CAL_STOP;
+	return;
+    }
+    if (cal_state == CAL_STOP) {
+	cal_ticks = now_ticks() - cal_ticks;
+	cal_state = CAL_DONE;
+	return;
+    }
+#endif
+
+    // the replies are queued with interrupts off.  letting the
+    // inverter in meanwhile would mean nesting this handler's frame
+    // under the others, and the stack (in 128 bytes of ram) has no
+    // room to spare for that.  ('U' is the exception, since it
+    // doesn't return until the host is done with it.)
     switch (c) {
     case 'h':
 	tx_str_p(usage_s);
@@ -624,12 +1016,50 @@ ISR(USART_RX_vect)
 	tx_str_p(fox_s);	/* quick brown fox */
 	break;
     case 'U':
+	// the loop runs for a long while, so it needs the transmit
+	// interrupt.  but not ours:  it watches RXC itself for the
+	// character that ends it.
+	UCSRB &= ~bit(RXCIE);
 	sei();
-	UUUU_loop();  		/* no return! */
+	UUUU_loop();  		/* until the next character */
+	cli();
+	UCSRB |= bit(RXCIE);
 	break;
     case 'v':
 	tx_str_p(version_s);	/* version */
 	break;
+#if DO_CALIBRATE
+    case 'c':
+	tx_str_p(cal_s);
+	cal_state = CAL_START;
+	break;
+    case 'C':
+	ee_write(EE_CAL_OSCCAL, OSCCAL);
+	ee_write(EE_CAL_MAGIC, CAL_MAGIC);
+	tx_str_p(saved_s);
+	break;
+#endif
+#if HIGH_BAUD
+    case '0':
+    case '7':
+    case '2':
+    case '5':
+	UCSRA |= bit(TXC);	/* clear it.  baud_check() watches it */
+	if (c == '0') {
+	    tx_str_p(baud_0_s);
+	    baud_want = BAUD_38400;
+	} else if (c == '7') {
+	    tx_str_p(baud_7_s);
+	    baud_want = BAUD_76800;
+	} else if (c == '2') {
+	    tx_str_p(baud_2_s);
+	    baud_want = BAUD_250000;
+	} else {
+	    tx_str_p(baud_5_s);
+	    baud_want = BAUD_500000;
+	}
+	break;
+#endif
     default:
 	tx_str_p(error_s);
 	break;
@@ -671,18 +1101,114 @@ ISR(USART_RX_vect)
 
 #define scale_denom(fosc) ((fosc / 256) / 4)
 
+#if DO_TIMESTAMPS
+/*
+ * convert a raw count to 16384ths, and send it.  only the new part
+ * is converted each time, keeping the remainder, so no precision is
+ * lost along the way.  we're normally called at least every timer1
+ * overflow, but not if the main loop is held up (or a burst runs
+ * long), so the new part is taken a timer1 overflow's worth at a
+ * time, where the multiply can't overflow.
+ */
+void
+tx_stamp(uint32_t t)
+{
+    uint32_t x, d, n;
+
+    if ((int32_t)(t - stamp_ticks) < 0)
+	return;		// older than one we've already sent
+
+    d = t - stamp_ticks;
+    while (d) {
+	n = (d > 0x10000) ? 0x10000 : d;
+	x = n * 4096 + stamp_rem;
+	stamp += x / scale_denom(FOSC);
+	stamp_rem = x % scale_denom(FOSC);
+	d -= n;
+    }
+    stamp_ticks = t;
+
+#if DO_RECEIVE
+    if (ascii)
+	return;
+#endif
+    tx_word(0);
+    tx_word(OOB_TIME_LO | (stamp & 0xfff));
+    tx_word(0);
+    tx_word(OOB_TIME_HI | ((stamp >> 12) & 0xfff));
+}
+#endif
+
+#if DO_CALIBRATE
+/*
+ * called from the main loop, once a calibration gap has been timed.
+ * answer with what we found, and step OSCCAL -- after the answer
+ * has gone, since the UART's rate moves with it.  big steps in
+ * OSCCAL can upset the clock, so we go one at a time.
+ */
+void
+cal_check(void)
+{
+    int32_t want = (uint32_t)CAL_MS * (FOSC / 256) / 1000;
+    int32_t err;
+    int8_t steps;
+
+    cal_state = CAL_IDLE;
+
+    err = ((int32_t)cal_ticks - want) * 10000 / want;
+
+    if (err > CAL_TOL || err < -CAL_TOL) {
+	steps = err / CAL_PER_STEP;
+	if (steps == 0)
+	    steps = (err > 0) ? 1 : -1;
+	if (steps > CAL_MAX_STEP)
+	    steps = CAL_MAX_STEP;
+	else if (steps < -CAL_MAX_STEP)
+	    steps = -CAL_MAX_STEP;
+    } else {
+	steps = 0;
+    }
+
+    tx_str_p(cal_s);
+    tx_char(' ');
+    tx_hexword(OSCCAL - steps);	// a fast clock (err > 0) needs less
+    tx_char(' ');
+    tx_hexword(err);
+    tx_str_p(crnl_s);
+
+    UCSRA |= bit(TXC);
+    while (tx_r != tx_w || !(UCSRA & bit(TXC)))
+	wdt_reset();
+
+    while (steps > 0) {
+	OSCCAL--;
+	steps--;
+    }
+    while (steps < 0) {
+	OSCCAL++;
+	steps++;
+    }
+}
+#endif
+
 void
 emit_pulse_data(void)
 {
     word len;
     byte high;
     byte overflow;
+#if DO_TIMESTAMPS
+    uint32_t edge;
+#endif
 
     while (pulse_length) {
 	cli();
 	len = pulse_length;
 	high = pulse_is_high;
 	overflow = had_overflow;
+#if DO_TIMESTAMPS
+	edge = edge_ticks;
+#endif
 
 	pulse_length = had_overflow = 0;
 
@@ -696,6 +1222,9 @@ emit_pulse_data(void)
 	    // overflow value to indicate that gap.  this is
 	    // effectively the start of a "packet".
 	    tx_word((overflow << 8) | 0xff);
+#if DO_TIMESTAMPS
+	    tx_stamp(edge);
+#endif
 	} else {
 	    uint32_t l;
 
@@ -736,7 +1265,7 @@ main(void)
 	/* a perfect square wave is useful for debugging the TX
 	 * inversion, and baud rate stability.
 	 */
-	UUUU_loop();	/* no return! */
+	UUUU_loop();	/* no return, in practice */
     }
 
     if (do_fox()) {
@@ -753,7 +1282,7 @@ main(void)
     for(;;) {
 	wdt_reset();
 	cli();
-	if (!pulse_length) {
+	if (!pulse_length && !heartbeat_due) {
 	    // only sleep if there's no pulse data to emit
 	    // (see <sleep.h> for explanation of this snippet)
 	    sleep_enable();
@@ -763,6 +1292,19 @@ main(void)
 	}
 	sei();
 	emit_pulse_data();
+#if DO_CALIBRATE
+	if (cal_state == CAL_DONE)
+	    cal_check();
+#endif
+	if (heartbeat_due) {
+	    tx_heartbeat();
+#if DO_TIMESTAMPS
+	    tx_stamp(now_ticks());
+#endif
+	}
+#if HIGH_BAUD
+	baud_check();
+#endif
     }
     /* not reached */
 
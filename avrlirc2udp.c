@@ -53,8 +53,18 @@
 #include <netdb.h>
 #include <sys/ioctl.h>
 #include <errno.h>
-
-#define LIRCD_UDP_PORT 8765
+#include <stdarg.h>
+#include <poll.h>
+#include <time.h>
+
+#include "avrhost.h"
+#include "pulseshm.h"
+#include "burststat.h"
+#include "tunnel.h"
+#include "flightrec.h"
+#ifdef USE_CUSE
+#include "lirccuse.h"
+#endif
 
 extern char *optarg;
 extern int optind, opterr, optopt;
@@ -68,273 +78,661 @@ int daemonized;
 #define DEBUG_AND_CONNECT 2
 int debug;
 
+/* optional shared memory ring, for local readers */
+pulseshm_t *shm;
+
+#define SHM_PREFIX "shm:"
+int wait_shm;
+
+/* optional /dev/lirc-style device, served via CUSE */
+int lirc_dev;
+
+/* send to the far end's -R, rather than straight to lircd */
+int tunnel;
+
+/*
+ * diversity mode:  several receivers (-t given more than once), of
+ * which only the best copy of each burst is forwarded.
+ */
+#define MAX_RX 4
+#define BURST_WORDS 512
+#define BURST_END_MS 30		/* this much silence ends a burst */
+#define DIVERSITY_MS 50		/* default window for matching bursts */
+
+typedef struct burst {
+    unsigned short w[BURST_WORDS];
+    int len;
+    int truncated;
+    int glitches;
+    int phased;			/* framer had to correct phase */
+    struct timespec start, last;
+} burst_t;
+
+typedef struct rx {
+    char *term;
+    int fd;
+    framer_t framer;
+    struct timespec heard;	/* last read from the tty */
+    unsigned long phase_base;	/* framer's count when 'cur' began */
+    burst_t cur;		/* being received */
+    burst_t ready;		/* complete, waiting to be combined */
+    int have_ready;
+    unsigned long chosen, dropped;
+    burststat_t quality;
+    int open_err;		/* why rx_open() last failed */
+} rx_t;
+
+rx_t rxs[MAX_RX];
+int nrx;
+int diversity_ms = DIVERSITY_MS;
+unsigned long bursts_combined;
+
+/* the framer and signal quality, for the single-tty case */
+framer_t framer;
+burststat_t quality;
+
 void
 usage(void)
 {
     fprintf(stderr,
-	"usage: %s [options] -t <ttydev> -h <lircd_host> [-p <lircd_port>]\n"
+	"usage: %s [options] -t <ttydev> [-h <lircd_host> [-p <lircd_port>]]\n"
+	"   or:  %s [options] -R <tcpport> -h <lircd_host> [-p <lircd_port>]\n"
 	"   lircd_port defaults to 8765.\n"
+	"   lircd_host may be 'unix:<path>', for a local unix-domain socket.\n"
 	"   use '-T' to make a TCP connection rather than UDP.\n"
+	"   use '-Z' to tunnel compressed bursts over TCP to another\n"
+	"       avrlirc2udp, running with '-R'.\n"
+	"   use '-R port' to receive a tunnel on TCP port, instead of reading\n"
+	"       a tty, and send each burst on to lircd as one datagram.\n"
 	"   use '-d' for debugging (with socket connection).\n"
 	"   use '-D' for debugging (without socket connection).\n"
 	"   use '-f' to keep program in foreground.\n"
 	"   use '-H' for high speed tty (115200 instead of 38400).\n"
-	"   use '-w S' to poll the creation of ttydev at S second intervals.\n"
-	, prog);
+	"   use '-B rate' to switch the device to 76800, 250000 or 500000 baud\n"
+	"       (it asks at 38400, so not with '-H', nor more than one '-t').\n"
+	"   use '-C' to calibrate the device's oscillator, and exit (with '-H',\n"
+	"       for a 115200 baud device).\n"
+	"   use '-w S' to wait for ttydev's creation (polling every S seconds,\n"
+	"       if it can't be watched).\n"
+	"   use '-W S' to reopen ttydev if the device stalls for S seconds\n"
+	"       (with just one '-t').\n"
+	"   use '-S name' to also publish the words in shared memory ring 'name'.\n"
+	"   SIGUSR1 reports link errors and signal quality histograms.\n"
+	"   SIGUSR2 (or a phase error) dumps the last few seconds of data\n"
+	"       to a file, named by '-F path' (default " FR_DIR "/%s-flight).\n"
+	"   give '-t' up to 4 times to combine receivers, forwarding only the\n"
+	"       best copy of each burst seen within '-G ms' (default 50).\n"
+	"   ttydev may be 'usb:<serial>', to find a usb adapter by serial number.\n"
+	"   ttydev may be 'shm:<name>', to relay from another instance's ring.\n"
+	"   use '-L name' to serve mode2 data on /dev/name (needs CUSE support).\n"
+	"   at least one of -h or -L is required, unless using '-D'.\n"
+	, prog, prog, prog);
     exit(1);
 }
 
 void
-report(char *s)
+report(const char *fmt, ...)
 {
-    if (daemonized)
-	syslog(LOG_NOTICE, "%s", s);
-    else
-	fprintf(stderr, "%s\n", s);
-}
+    va_list ap;
 
-void
-die(char *s)
-{
+    va_start(ap, fmt);
     if (daemonized) {
-	syslog(LOG_ERR, "%s: %m", s);
-	syslog(LOG_ERR, "exiting");
+	vsyslog(LOG_NOTICE, fmt, ap);
     } else {
-	perror(s);
+	fprintf(stderr, "%s: ", prog);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
     }
-    exit(1);
+    va_end(ap);
 }
 
-int socket_init(int tcp, char *host, int port)
+void
+die(const char *fmt, ...)
 {
-    struct sockaddr_in sa[1];
-    struct hostent *hent;
-    int s;
-
-    hent = gethostbyname(host);
-    if (!hent) {
-	fprintf(stderr, "%s: gethostbyname: ", prog);
-        herror(host);
-	exit(1);
-    }
+    va_list ap;
+    int e = errno;
 
-    if (tcp) {
-	if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-	    die("socket");
+    va_start(ap, fmt);
+    if (daemonized) {
+	vsyslog(LOG_ERR, fmt, ap);
+	syslog(LOG_ERR, "exiting -- %s", strerror(e));
     } else {
-	if ((s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
-	    die("socket");
+	fprintf(stderr, "%s: ", prog);
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, " - %s\n", strerror(e));
     }
+    va_end(ap);
+    exit(1);
+}
 
-    memset((char *) sa, 0, sizeof(*sa));
-    sa->sin_family = AF_INET;
-    sa->sin_port = htons(port);
-    sa->sin_addr = *((struct in_addr *)hent->h_addr);
-       
-    if (connect(s, (struct sockaddr *)sa, sizeof(*sa)) < 0)
-	return -1;
-
-    return s;
+void
+sighandler(int sig)
+{
+    tty_restore();
+    die("got signal %d", sig);
 }
 
-/* shared by tty_init()/tty_restore() */
-struct termios prev_tios;
-int tty_fd;
+/*
+ * SIGUSR1 reports the tty error counters, diversity stats, and
+ * the signal quality histograms.  report() isn't safe in a signal
+ * handler, so the handler just sets a flag for the main loop, which
+ * calls check_signals().  the handler is installed without
+ * SA_RESTART, so a blocked read or poll returns to the loop at once.
+ */
+volatile sig_atomic_t stats_due;
 
 void
-tty_restore(void)
+statshandler(int sig)
 {
-    tcsetattr(tty_fd, TCSADRAIN, &prev_tios);
+    stats_due = 1;
 }
 
 void
-sighandler(int sig)
+catch_signal(int sig, void (*fn)(int))
 {
-    tty_restore();
-    die("signal");
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = fn;
+    sigemptyset(&sa.sa_mask);
+    sigaction(sig, &sa, 0);
 }
 
-int tty_init(char *term, int wait_term, int speed)
+void
+dump_stats(void)
 {
-    int s;
-    struct termios tios;
-    int flags;
+    int i;
+
+    tty_stats();
+    if (nrx > 1) {
+	report("%lu bursts combined", bursts_combined);
+	for (i = 0; i < nrx; i++) {
+	    report("  %s: chosen %lu, dropped %lu",
+		rxs[i].term, rxs[i].chosen, rxs[i].dropped);
+	    framer_stats(&rxs[i].framer, rxs[i].term);
+	    burststat_dump(&rxs[i].quality);
+	}
+    } else {
+	framer_stats(&framer, "framer");
+	if (quality.name)
+	    burststat_dump(&quality);
+    }
+}
 
-    int logged = 0;
+void
+check_signals(void)
+{
+    if (stats_due) {
+	stats_due = 0;
+	dump_stats();
+    }
+    flightrec_service();
+}
 
-    while(1) {
-	tty_fd = open(term, O_RDWR);
-	if (tty_fd >= 0 || errno != ENOENT || !wait_term)
-	    break;
+/* SIGUSR2 dumps the flight recorder, from check_signals() */
+void
+flighthandler(int sig)
+{
+    flightrec_request("requested", 0);
+}
 
-	if (!logged)
-	    report("waiting for tty creation");
+void
+process_oob(void *arg, unsigned short w)
+{
+    // nothing here
+}
 
-	logged = 1;
+void
+process_word(void *arg, unsigned short w)
+{
+    dest_t *to = arg;
+    unsigned char b[2];
 
-	sleep(wait_term);
+    if (debug) {
+	fprintf(stderr, "%s 0x%04x (%d)\n",
+	    (w & 0x8000) ? "pulse":"space", w, w & 0x7fff);
     }
 
-    if (logged)
-	report("found tty");
-
-    if (tty_fd < 0)
-	die("can't open tty");
+    if (debug != DEBUG_ONLY && to->host)  { // sending to host
+	if (tunnel) {
+	    tunnel_word(to, w);
+	} else {
+	    b[0] = w & 0xff;
+	    b[1] = w >> 8;
+	    if (dest_send(to, b, 2) < 0 && errno != ECONNREFUSED)
+		report("write failed (%s), reconnecting", strerror(errno));
+	}
+    }
 
-    if (!isatty(tty_fd))
-	die("not a tty");
+    if (shm)
+	pulseshm_put(shm, w);
 
-    s = tcgetattr(tty_fd, &prev_tios);
-    if (s < 0)
-	die("ttopen tcgetattr");
+#ifdef USE_CUSE
+    if (lirc_dev)
+	lirccuse_put(w);
+#endif
+}
 
-    /* set up restore hooks quickly */
-    atexit(tty_restore);
-    signal(SIGTERM, sighandler);
-    signal(SIGHUP, sighandler);
+/*
+ * become a daemon, if we're going to, and then start anything that
+ * needs threads, since those don't survive the fork.
+ */
+void
+go_background(int foreground, char *lirc_name)
+{
+    if (!daemonized && !foreground && !debug) {
+	if (daemon(0, 0) < 0)
+	    die("daemon");
+	daemonized = 1;
+    }
 
-    tios = prev_tios;
-
-    tios.c_oflag = 0;	/* no output flags at all */
-    tios.c_lflag = 0;	/* no line flags at all */
-
-    tios.c_cflag &= ~PARENB;	/* disable parity, both in and out */
-    tios.c_cflag |= CSTOPB|CLOCAL|CS8|CREAD;   /* two stop bits on transmit */
-					    /* no modem control, 8bit chars, */
-					    /* receiver enabled, */
-
-    tios.c_iflag = IGNBRK | IGNPAR;    /* ignore break, ignore parity errors */
-
-    tios.c_cc[VMIN] = 2;
-    tios.c_cc[VTIME] = 0;
-    tios.c_cc[VSUSP]  = _POSIX_VDISABLE;
-    tios.c_cc[VSTART] = _POSIX_VDISABLE;
-    tios.c_cc[VSTOP]  = _POSIX_VDISABLE;
-
-    s = cfsetospeed (&tios, speed);
-    if (s < 0)
-	die("ttopen cfsetospeed");
-    s = cfsetispeed (&tios, speed);
-    if (s < 0)
-	die("ttopen cfsetispeed");
-    s = tcsetattr(tty_fd, TCSAFLUSH, &tios);
-    if (s < 0)
-	die("ttopen tcsetattr");
-
-    /* make sure RTS and DTR lines are high, since device may be
-     * phantom-powered.  no termios/posix way to do this, that i
-     * know of.
-     */
-    if (ioctl(tty_fd, TIOCMGET, &flags) >= 0) {
-	flags &= ~TIOCM_RTS;
-	flags &= ~TIOCM_DTR;
-	ioctl(tty_fd, TIOCMSET, &flags);
+#ifdef USE_CUSE
+    if (lirc_name && !lirc_dev) {
+	lirccuse_start(lirc_name);
+	lirc_dev = 1;
+	/* libfuse will have installed its own */
+	signal(SIGTERM, sighandler);
+	signal(SIGHUP, sighandler);
+	signal(SIGINT, SIG_DFL);
     }
+#endif
+}
+
+/* wait up to 'ms' for input.  returns true if there is some. */
+int
+readable(int fd, int ms)
+{
+    struct pollfd pfd;
 
-    return tty_fd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, ms) != 0;
 }
 
+/* words straight from a single tty */
 void
-process_oob(int from, unsigned char *buf)
+tty_word(void *arg, unsigned short w)
 {
-    // nothing here
+    burststat_word(&quality, w);
+    process_word(arg, w);
 }
 
 void
-data_loop(int from, int tcp, char *host, int port)
+data_loop(int from, dest_t *to)
 {
-    unsigned char b[2];
     int n;
-    int prevhighbit = -1;
-#if OUT_OF_BAND_SOMEDAY
-    int prevwaszero;
-#endif
-    int highbit;
-    static int to = -1;
+
+    framer_init(&framer, tty_word, process_oob, to);
 
     while (1) {
 
-	/* leave extra space in buf for extra bytes we may read below */
-	if ((n = read(from, b, 2)) < 0)
+	check_signals();
+
+	/* the tunnel sends each burst once it has gone quiet */
+	if (tunnel_pending() && !readable(from, TUNNEL_IDLE_MS)) {
+	    tunnel_flush(to);
+	    continue;
+	}
+
+	n = framer_read(&framer, from);
+	if (n == FRAMER_ERR) {
+	    if (errno == EINTR)
+		continue;
 	    die("read");
+	}
 
 	/* in my experience, this results from a USB serial
 	 * device being unplugged */
-	if (n == 0)
+	if (n == FRAMER_EOF)
 	    return;
 
-	if (n == 1) { /* short read -- force it even */
-	    if (read(from, &b[1], 1) <= 0)
-		die("read");
-	    n++;
+	/* reopening wouldn't help, so start over right here */
+	if (n == FRAMER_LOST) {
+	    report("too many phase corrections, starting over");
+	    framer_reset(&framer);
+	    continue;
 	}
 
-	if (debug) {
-	    int pulse;
-	    pulse = (b[1] << 8) + b[0];
-	    pulse &= 0xffff;
-	    fprintf(stderr, "%s 0x%04x (%d)\n",
-		(pulse & 0x8000) ? "pulse":"space", pulse, pulse & 0x7fff);
+	if (n == FRAMER_STALL) {
+	    report("device stalled, re-opening tty");
+	    return;
 	}
 
-#if OUT_OF_BAND_SOMEDAY
-	if (oob) {  // these bytes are out-of-band
-	    process_oob(from, b);
-	    prevhighbit = -1;
-	    prevwaszero = 0;
-	    oob = 0;
+	/* wake any readers once per read, not once per word */
+	if (shm)
+	    pulseshm_flush(shm);
+    }
+}
+
+/*
+ * relay from another instance's shared memory ring, rather than
+ * from a tty.  the words are copied out before being used, so that
+ * anything the producer overwrites while we're looking can be
+ * discarded rather than forwarded.
+ */
+void
+shm_loop(char *name, dest_t *to)
+{
+    static pulseshm_reader_t reader;
+    uint16_t buf[PULSESHM_WORDS];
+    const uint16_t *words;
+    unsigned long lost = 0;
+    int i, n;
+
+    while (pulseshm_open(&reader, name) < 0) {
+	if (!wait_shm)
+	    die("can't open shared memory ring '%s'", name);
+	sleep(wait_shm);
+    }
+
+    while (1) {
+	check_signals();
+
+	n = pulseshm_peek(&reader, &words);
+	if (!n) {
+	    if (tunnel_pending()) {
+		if (!pulseshm_wait(&reader, TUNNEL_IDLE_MS))
+		    tunnel_flush(to);
+	    } else {
+		pulseshm_wait(&reader, -1);
+	    }
 	    continue;
 	}
 
-	//if (debug)
-	//    debug_buffer("", buf, n);
+	memcpy(buf, words, n * sizeof(buf[0]));
+	if (pulseshm_consume(&reader, n) < 0)
+	    n = 0;
+
+	if (reader.lost != lost) {
+	    report("fell behind, %lu words lost", reader.lost - lost);
+	    lost = reader.lost;
+	}
+
+	for (i = 0; i < n; i++)
+	    process_word(to, buf[i]);
+    }
+}
+
+/*
+ * diversity combining.
+ *
+ * each receiver's words are collected into bursts, which end after
+ * BURST_END_MS of silence on that tty.  the first burst to finish
+ * opens a window of diversity_ms.  when that closes, every finished
+ * burst that started within the window of the first one is a copy
+ * of the same button press, and only the best of them is forwarded:
+ * one without phase corrections, then the most complete (longest),
+ * then the one with the fewest glitches.  the price is that bursts
+ * are forwarded when they end, plus the window, rather than as the
+ * words arrive.
+ */
+
+static long
+ms_between(struct timespec *a, struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) * 1000 +
+	(b->tv_nsec - a->tv_nsec) / 1000000;
+}
+
+struct timespec rx_now;
+
+/* the burst that opened the current window, and when it closes */
+rx_t *rx_first;
+struct timespec rx_window_end;
+
+void
+rx_word(void *arg, unsigned short w)
+{
+    rx_t *rx = arg;
+    burst_t *b = &rx->cur;
+
+    if (!b->len) {
+	b->start = rx_now;
+	b->glitches = 0;
+	b->truncated = 0;
+	rx->phase_base = rx->framer.phase_corrections;
+    }
+    b->last = rx_now;
+
+    if ((w & 0x7fff) < BS_GLITCH_TICKS)
+	b->glitches++;
+
+    if (b->len == BURST_WORDS) {
+	b->truncated = 1;
+	return;
+    }
+    b->w[b->len++] = w;
+}
+
+/* returns true if burst a is better than burst b */
+static int
+burst_better(burst_t *a, burst_t *b)
+{
+    if (a->phased != b->phased)
+	return b->phased;
+    if (a->truncated != b->truncated)
+	return b->truncated;
+    if (a->len != b->len)
+	return a->len > b->len;
+    return a->glitches < b->glitches;
+}
+
+static int
+rx_matches(rx_t *rx, rx_t *first)
+{
+    return rx->have_ready &&
+	labs(ms_between(&first->ready.start, &rx->ready.start)) <= diversity_ms;
+}
+
+static void
+rx_open_window(rx_t *rx)
+{
+    rx_first = rx;
+    rx_window_end = rx_now;
+    rx_window_end.tv_nsec += diversity_ms * 1000000L;
+    rx_window_end.tv_sec += rx_window_end.tv_nsec / 1000000000L;
+    rx_window_end.tv_nsec %= 1000000000L;
+}
+
+/*
+ * forward the best of the finished bursts that match the one that
+ * opened the window, and discard the rest.
+ */
+static void
+rx_combine(dest_t *to)
+{
+    rx_t *best = 0, *rx, *first = rx_first;
+    int i, ncopies = 0;
 
-	if (b[0] == 0 && b[1] == 0) {
-	    // then we're definitely in phase
-	    oob = 1;
-	    prevwaszero = 0;
+    for (i = 0; i < nrx; i++) {
+	rx = &rxs[i];
+	if (!rx_matches(rx, first))
 	    continue;
-	} 
-
-	oob = 0;
-
-	if (prevwaszero && b[0] == 0) {
-	    // then we're definitely out of phase
-	    report("phase correction");
-	    b[0] = b[1];
-	    if (read(from, &b[1], 1) <= 0)
-		die("read");
-	    process_oob(from, b);
-	    prevhighbit = -1;
-	    prevwaszero = 0;
+	ncopies++;
+	if (!best || burst_better(&rx->ready, &best->ready))
+	    best = rx;
+    }
+
+    if (debug && ncopies > 1)
+	fprintf(stderr, "%d copies, using %s\n", ncopies, best->term);
+
+    for (i = 0; i < best->ready.len; i++)
+	process_word(to, best->ready.w[i]);
+    if (shm)
+	pulseshm_flush(shm);
+    if (tunnel)
+	tunnel_flush(to);
+    best->chosen++;
+    bursts_combined++;
+
+    for (i = 0; i < nrx; i++) {
+	rx = &rxs[i];
+	if (!rx_matches(rx, first))
 	    continue;
+	if (rx != best)
+	    rx->dropped++;
+	rx->have_ready = 0;
+    }
+
+    /* anything left over opens the next window */
+    rx_first = 0;
+    for (i = 0; i < nrx; i++) {
+	if (rxs[i].have_ready) {
+	    rx_open_window(&rxs[i]);
+	    break;
 	}
-#endif
-	
-	highbit = (b[1] & 0x80);
-	if (highbit == prevhighbit) {
-	    report("phase correction");
-	    b[0] = b[1];
-	    if (read(from, &b[1], 1) <= 0)
-		die("read");
-	    highbit = (b[1] & 0x80);
+    }
+}
+
+/* a receiver's current burst has gone quiet */
+static void
+rx_finish(rx_t *rx, dest_t *to)
+{
+    /* its previous burst is still waiting?  then that window is
+     * over, as far as we're concerned. */
+    while (rx->have_ready)
+	rx_combine(to);
+
+    rx->cur.phased = (rx->framer.phase_corrections != rx->phase_base);
+    burststat_burst(&rx->quality, rx->cur.w, rx->cur.len);
+    rx->ready = rx->cur;
+    rx->have_ready = 1;
+    rx->cur.len = 0;
+
+    if (!rx_first)
+	rx_open_window(rx);
+}
+
+/* start a receiver's framer (and its burst) afresh */
+static void
+rx_reset(rx_t *rx)
+{
+    framer_init(&rx->framer, rx_word, process_oob, rx);
+    rx->framer.recid = rx - rxs;
+    rx->cur.len = 0;
+}
+
+/*
+ * try to (re)open a receiver, without waiting for it, or holding up
+ * the others.  if it's not there, or not usable yet (e.g., udev
+ * hasn't fixed its permissions), we'll try again on the next pass.
+ */
+static void
+rx_open(rx_t *rx, int speed)
+{
+    rx->fd = tty_try_open(rx->term, speed);
+    if (rx->fd < 0) {
+	if (errno != ENOENT && errno != rx->open_err)
+	    report("%s: %s, will retry", rx->term, strerror(errno));
+	rx->open_err = errno;
+	return;
+    }
+    rx->open_err = 0;
+
+    rx_reset(rx);
+    report("receiver %s is up", rx->term);
+}
+
+static void
+rx_down(rx_t *rx, char *why, int wait_term)
+{
+    if (!wait_term)
+	die("%s: %s", rx->term, why);
+    report("%s: %s, will reopen", rx->term, why);
+    tty_release(rx->fd);
+    rx->fd = -1;
+    rx->cur.len = 0;
+}
+
+void
+rx_lost(rx_t *rx)
+{
+    report("%s: too many phase corrections, starting over", rx->term);
+    framer_reset(&rx->framer);
+}
+
+void
+diversity_loop(dest_t *to, int wait_term, int speed)
+{
+    struct pollfd pfds[MAX_RX];
+    unsigned char buf[FRAMER_BUFSIZE];
+    struct timespec last_retry = {0, 0};
+    rx_t *rx;
+    long wait, t;
+    int i, n, r;
+
+    while (1) {
+	check_signals();
+
+	clock_gettime(CLOCK_MONOTONIC, &rx_now);
+
+	/* bring back any missing receivers, once a second */
+	if (ms_between(&last_retry, &rx_now) >= 1000) {
+	    last_retry = rx_now;
+	    for (i = 0; i < nrx; i++)
+		if (rxs[i].fd < 0)
+		    rx_open(&rxs[i], speed);
 	}
-	prevhighbit = highbit;
-#if OUT_OF_BAND_SOMEDAY
-	prevwaszero = (b[1] == 0);
-#endif
 
-	if (debug != DEBUG_ONLY)  { // sending to host
-	    if (to < 0)
-		to = socket_init(tcp, host, port);
-	    if (to >= 0) {
-		if (write(to, b, 2) < 0) {
-		    if (errno != ECONNREFUSED)
-			die("write");
-		}
+	/* sleep until something arrives, a burst ends, or the
+	 * window closes */
+	wait = 1000;
+	for (i = 0; i < nrx; i++) {
+	    rx = &rxs[i];
+	    pfds[i].fd = rx->fd;
+	    pfds[i].events = POLLIN;
+	    if (rx->cur.len) {
+		t = BURST_END_MS - ms_between(&rx->cur.last, &rx_now);
+		if (t < wait)
+		    wait = t;
 	    }
+	    if (rx->framer.resyncing && wait > FRAMER_IDLE_MS)
+		wait = FRAMER_IDLE_MS;
+	}
+	if (rx_first) {
+	    t = ms_between(&rx_now, &rx_window_end);
+	    if (t < wait)
+		wait = t;
+	}
+	if (wait < 0)
+	    wait = 0;
+
+	n = poll(pfds, nrx, wait);
+	if (n < 0 && errno != EINTR)
+	    die("poll");
+
+	clock_gettime(CLOCK_MONOTONIC, &rx_now);
+
+	for (i = 0; n > 0 && i < nrx; i++) {
+	    rx = &rxs[i];
+	    if (rx->fd < 0 || !(pfds[i].revents & (POLLIN|POLLHUP|POLLERR)))
+		continue;
+	    r = read(rx->fd, buf, sizeof(buf));
+	    if (r <= 0)
+		rx_down(rx, r < 0 ? strerror(errno) : "tty gone", wait_term);
+	    else if (framer_push(&rx->framer, buf, r) < 0)
+		rx_lost(rx);
+	    rx->heard = rx_now;
 	}
 
+	/* settle any resync held open by a receiver that's gone quiet */
+	for (i = 0; i < nrx; i++) {
+	    rx = &rxs[i];
+	    if (rx->fd >= 0 && rx->framer.resyncing &&
+		    ms_between(&rx->heard, &rx_now) >= FRAMER_IDLE_MS &&
+		    framer_flush(&rx->framer) < 0)
+		rx_lost(rx);
+	}
+
+	/* finish bursts that have gone quiet */
+	for (i = 0; i < nrx; i++) {
+	    rx = &rxs[i];
+	    if (rx->cur.len && ms_between(&rx->cur.last, &rx_now) >= BURST_END_MS)
+		rx_finish(rx, to);
+	}
+
+	if (rx_first && ms_between(&rx_now, &rx_window_end) <= 0)
+	    rx_combine(to);
     }
 }
 
@@ -349,17 +747,30 @@ main(int argc, char *argv[])
     int tcp = 0;
     int speed = B38400;
     int tty;
-    int c;
+    int c, i;
+    char *shm_name = 0;
+    char *lirc_name = 0;
+    int tunnel_port = 0;
+    int calibrate = 0;
+    static dest_t to;
 
     prog = argv[0];
     p = strrchr(argv[0], '/');
     if (p) prog = p + 1;
 
-    while ((c = getopt(argc, argv, "HdDTfw:t:h:p:")) != EOF) {
+    while ((c = getopt(argc, argv, "HB:CdDTZR:fw:W:t:h:p:S:L:G:F:")) != EOF) {
 	switch (c) {
 	case 'H':
 	    speed = B115200;
 	    break;
+	case 'B':
+	    tty_fast_rate = tty_parse_rate(optarg);
+	    if (!tty_fast_rate)
+		usage();
+	    break;
+	case 'C':
+	    calibrate = 1;
+	    break;
 	case 'd':
 	    debug = DEBUG_AND_CONNECT;
 	    break;
@@ -370,53 +781,151 @@ main(int argc, char *argv[])
 	    foreground = 1;
 	    break;
 	case 't':
-	    term = optarg;
+	    if (nrx == MAX_RX)
+		usage();
+	    term = rxs[nrx++].term = optarg;
+	    break;
+	case 'G':
+	    diversity_ms = atoi(optarg);
+	    if (diversity_ms <= 0)
+		usage();
+	    break;
+	case 'F':
+	    flightrec_path = optarg;
 	    break;
 	case 'w':
 	    wait_term = atoi(optarg);
 	    if (wait_term == 0)
 		usage();
 	    break;
+	case 'W':
+	    tty_watch = atoi(optarg);
+	    if (tty_watch < TTY_MIN_WATCH)
+		usage();
+	    break;
 	case 'h':
 	    host = optarg;
 	    break;
 	case 'T':
 	    tcp = 1;
 	    break;
+	case 'Z':
+	    tunnel = tcp = 1;
+	    break;
+	case 'R':
+	    tunnel_port = atoi(optarg);
+	    if (!tunnel_port)
+		usage();
+	    break;
 	case 'p':   /*	or microseconds */
 	    port = atoi(optarg);
 	    break;
+	case 'S':
+	    shm_name = optarg;
+	    break;
+	case 'L':
+	    lirc_name = optarg;
+	    break;
 	default:
 	    usage();
 	    break;
 	}
     }
 
-    if ((debug != DEBUG_ONLY && !host) || !term || optind != argc) {
+    /* the switch is always asked for at the device's 38400.  and
+     * with several receivers, it would hold up the others each time
+     * one was reopened. */
+    if (tty_fast_rate && (speed != B38400 || nrx > 1))
 	usage();
-    }
 
-    while (1) {
+    /* the stall watchdog keeps state for just one tty */
+    if (tty_watch && nrx > 1)
+	usage();
 
-	tty = tty_init(term, wait_term, speed);
+    if (calibrate) {
+	if (!term || nrx != 1 || optind != argc)
+	    usage();
+	exit(tty_calibrate(term,
+		speed == B115200 ? 115200 : TTY_BASE_RATE) ? 1 : 0);
+    }
 
-	if (!daemonized && !foreground && !debug) {
+    if (tunnel_port) {
+	if (!host || term || tunnel || tcp || optind != argc)
+	    usage();
+	dest_init(&to, host, port, 0);
+	signal(SIGTERM, sighandler);
+	signal(SIGHUP, sighandler);
+	if (!foreground && !debug) {
 	    if (daemon(0, 0) < 0)
 		die("daemon");
 	    daemonized = 1;
 	}
+	tunnel_receive(tunnel_port, &to);
+    }
+
+    if ((debug != DEBUG_ONLY && !host && !lirc_name) ||
+	    !term || optind != argc) {
+	usage();
+    }
+
+#ifndef USE_CUSE
+    if (lirc_name) {
+	errno = ENOSYS;
+	die("not built with CUSE support, -L unavailable");
+    }
+#endif
+
+    dest_init(&to, host, port, tcp);
+
+    signal(SIGTERM, sighandler);
+    signal(SIGHUP, sighandler);
+    catch_signal(SIGUSR1, statshandler);
+    catch_signal(SIGUSR2, flighthandler);
+    flightrec_init(prog);
+
+    if (shm_name)
+	shm = pulseshm_create(shm_name);
+
+    if (!strncmp(term, SHM_PREFIX, strlen(SHM_PREFIX))) {
+	go_background(foreground, lirc_name);
+	wait_shm = wait_term;
+	shm_loop(term + strlen(SHM_PREFIX), &to);
+    }
+
+    if (nrx > 1) {
+	for (i = 0; i < nrx; i++) {
+	    rxs[i].fd = -1;
+	    burststat_init(&rxs[i].quality, rxs[i].term);
+	    rx_reset(&rxs[i]);
+	    if (wait_term)
+		rx_open(&rxs[i], speed);
+	    else	/* insist on them all being there */
+		rxs[i].fd = tty_init(rxs[i].term, 0, speed);
+	}
+	go_background(foreground, lirc_name);
+	diversity_loop(&to, wait_term, speed);
+    }
+
+    burststat_init(&quality, term);
+
+    while (1) {
+
+	tty = tty_init(term, wait_term, speed);
+
+	go_background(foreground, lirc_name);
 
-	data_loop(tty, tcp, host, port);
+	data_loop(tty, &to);
 
 	/* we'll only ever return from data_loop() if our read()
 	 * returns 0, which usually means our (USB-based) tty has
-	 * gone away.  loop if we were told to wait (-w) for it.
+	 * gone away, or if the watchdog fired.
+	 * loop if we were told to wait (-w) for it, or to watch
+	 * it (-W).
 	 */
-	if (!wait_term)
+	if (!wait_term && !tty_watch)
 	    die("end-of-dataloop");
 
-	tty_restore();
-	close(tty);
+	tty_release(tty);
     }
 
     return 0;
@@ -0,0 +1,193 @@
+/*
+ * burststat.c
+ *
+ * per-burst signal quality statistics.  see burststat.h.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "avrhost.h"
+#include "burststat.h"
+
+#define TICKS(w) ((w) & 0x7fff)
+#define IS_PULSE(w) ((w) & 0x8000)
+#define IS_GAP(w) (!IS_PULSE(w) && TICKS(w) >= BS_GAP_TICKS)
+
+#define TICK_USEC(t) ((long)(t) * 1000000 / 16384)
+
+void
+burststat_init(burststat_t *bs, char *name)
+{
+    memset(bs, 0, sizeof(*bs));
+    bs->name = name;
+}
+
+static void
+hist_add(unsigned long *hist, int nbins, int v)
+{
+    if (v < 0)
+        v = 0;
+    if (v > nbins)
+        v = nbins;
+    hist[v]++;
+}
+
+/*
+ * guess the protocol's basic time unit for this burst.  nearly every
+ * IR protocol builds its pulses and spaces from small multiples of
+ * one unit (NEC's 562usec, RC5's 889usec, etc.), and the shortest
+ * widths are usually one unit.  so take the shortest non-glitch
+ * width, and average everything within 35% of it.  returns the unit
+ * in 1/16ths of a tick, or 0 if there's nothing to go on.
+ */
+static int
+grid_unit(const unsigned short *w, int n)
+{
+    int i, t, min = 0x7fff;
+    long sum = 0;
+    int count = 0;
+
+    for (i = 0; i < n; i++) {
+        t = TICKS(w[i]);
+        if (t >= BS_GLITCH_TICKS && t < min)
+            min = t;
+    }
+    if (min == 0x7fff)
+        return 0;
+
+    for (i = 0; i < n; i++) {
+        t = TICKS(w[i]);
+        if (t >= BS_GLITCH_TICKS && t * 100 <= min * 135) {
+            sum += t;
+            count++;
+        }
+    }
+    return sum * 16 / count;
+}
+
+/* analyze one complete burst.  leading or trailing gaps are ignored. */
+void
+burststat_burst(burststat_t *bs, const unsigned short *w, int n)
+{
+    int i, t, k, unit, err;
+
+    while (n && IS_GAP(w[0])) {
+        w++;
+        n--;
+    }
+    while (n && IS_GAP(w[n - 1]))
+        n--;
+    if (!n)
+        return;
+
+    bs->bursts++;
+    bs->words += n;
+    hist_add(bs->len_hist, BS_LEN_BINS, n / BS_LEN_BIN);
+
+    for (i = 0; i < n; i++) {
+        t = TICKS(w[i]);
+        if (t < BS_GLITCH_TICKS)
+            bs->glitches++;
+        if (IS_PULSE(w[i]))
+            hist_add(bs->pulse_hist, BS_WIDTH_BINS, t / BS_WIDTH_BIN);
+        else
+            hist_add(bs->space_hist, BS_WIDTH_BINS, t / BS_WIDTH_BIN);
+    }
+
+    unit = grid_unit(w, n);
+    if (!unit) {
+        bs->gridless++;
+        return;
+    }
+    hist_add(bs->grid_hist, BS_GRID_BINS, unit / 16);
+
+    /* how far is each width from a whole number of units? */
+    for (i = 0; i < n; i++) {
+        t = TICKS(w[i]) * 16;
+        k = (t + unit / 2) / unit;
+        if (k < 1 || k > BS_MAX_MULT)
+            continue;   /* headers, trailers, glitches */
+        err = (t - k * unit) * 100 / unit;
+        if (err < 0)
+            err = -err;
+        hist_add(bs->jitter_hist, BS_JITTER_BINS - 1, err / BS_JITTER_BIN);
+    }
+}
+
+/* feed a word stream, finding the bursts in it by the gaps between */
+void
+burststat_word(burststat_t *bs, unsigned short w)
+{
+    if (IS_GAP(w) || bs->len == BS_MAX_WORDS) {
+        burststat_burst(bs, bs->w, bs->len);
+        bs->len = 0;
+    }
+    if (!IS_GAP(w))
+        bs->w[bs->len++] = w;
+}
+
+static void
+hist_dump(char *what, unsigned long *hist, int nbins, int binsize,
+        int usec)
+{
+    char line[128];
+    int i, lo;
+
+    for (i = 0; i <= nbins; i++) {
+        if (!hist[i])
+            continue;
+        lo = i * binsize;
+        if (usec)
+            lo = TICK_USEC(lo);
+        snprintf(line, sizeof(line), "    %s %s%d%s: %lu", what,
+                i == nbins ? ">=" : "", lo, usec ? "us" : "", hist[i]);
+        report("%s", line);
+    }
+}
+
+void
+burststat_dump(burststat_t *bs)
+{
+    unsigned long total = 0, good = 0;
+    int i;
+
+    for (i = 0; i < BS_JITTER_BINS; i++) {
+        total += bs->jitter_hist[i];
+        if (i * BS_JITTER_BIN < 15)
+            good += bs->jitter_hist[i];
+    }
+
+    report("%s: %lu bursts, %lu words, %lu glitches, %lu without a grid; "
+            "%lu%% of widths within 15%% of the grid",
+            bs->name, bs->bursts, bs->words, bs->glitches, bs->gridless,
+            total ? good * 100 / total : 0);
+
+    hist_dump("pulse", bs->pulse_hist, BS_WIDTH_BINS,
+            BS_WIDTH_BIN, 1);
+    hist_dump("space", bs->space_hist, BS_WIDTH_BINS,
+            BS_WIDTH_BIN, 1);
+    hist_dump("length", bs->len_hist, BS_LEN_BINS, BS_LEN_BIN, 0);
+    hist_dump("grid unit", bs->grid_hist, BS_GRID_BINS, 1, 1);
+    hist_dump("grid error %", bs->jitter_hist, BS_JITTER_BINS - 1,
+            BS_JITTER_BIN, 0);
+}
@@ -0,0 +1,72 @@
+/*
+ * burststat.h
+ *
+ * per-receiver signal quality statistics, gathered a burst at a
+ * time:  pulse and space width histograms, burst lengths, glitches,
+ * and how well each burst's timing fits a regular grid.  a remote
+ * that "works badly in that room" usually shows up here (as jitter,
+ * or glitches) well before lircd starts missing buttons.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef BURSTSTAT_H
+#define BURSTSTAT_H
+
+/* all durations are in avrlirc ticks, 1/16384 sec (61usec) */
+#define BS_GLITCH_TICKS 2       /* shorter than this is noise */
+#define BS_GAP_TICKS 164        /* a space this long (10ms) separates bursts */
+#define BS_MAX_WORDS 512
+
+#define BS_WIDTH_BIN 2          /* width histograms:  2 ticks per bin... */
+#define BS_WIDTH_BINS 64        /* ...up to 7.8ms, plus an overflow bin */
+#define BS_LEN_BIN 8            /* burst lengths:  8 words per bin */
+#define BS_LEN_BINS 32
+#define BS_GRID_BINS 64         /* estimated grid unit, 1 tick per bin */
+#define BS_JITTER_BIN 5         /* grid error:  5% of the unit per bin */
+#define BS_JITTER_BINS 10       /* (the last bin is "off the grid") */
+#define BS_MAX_MULT 16          /* longer than this many units isn't data */
+
+typedef struct burststat {
+    char *name;
+
+    /* totals */
+    unsigned long bursts;
+    unsigned long words;
+    unsigned long glitches;
+    unsigned long gridless;     /* bursts with no usable grid */
+
+    unsigned long pulse_hist[BS_WIDTH_BINS + 1];
+    unsigned long space_hist[BS_WIDTH_BINS + 1];
+    unsigned long len_hist[BS_LEN_BINS + 1];
+    unsigned long grid_hist[BS_GRID_BINS + 1];
+    unsigned long jitter_hist[BS_JITTER_BINS];
+
+    /* the burst being collected by burststat_word() */
+    unsigned short w[BS_MAX_WORDS];
+    int len;
+} burststat_t;
+
+void burststat_init(burststat_t *bs, char *name);
+void burststat_word(burststat_t *bs, unsigned short w);
+void burststat_burst(burststat_t *bs, const unsigned short *w, int n);
+void burststat_dump(burststat_t *bs);
+
+#endif /* BURSTSTAT_H */
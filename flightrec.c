@@ -0,0 +1,236 @@
+/*
+ * flightrec.c
+ *
+ * the flight recorder.  see flightrec.h.
+ *
+ * a dump is a text file, one entry per line:  the time (in seconds
+ * before the newest entry), the receiver, and what happened.  for
+ * words, that's "pulse" or "space" and the duration in ticks.
+ *
+ * dumps are written while the tty reader carries on recording, so
+ * the newest few entries can be caught half-written.  that's fine
+ * for a diagnostic snapshot.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "avrhost.h"
+#include "flightrec.h"
+
+fr_entry_t fr_ring[FR_ENTRIES];
+unsigned int fr_head;
+unsigned long long fr_now;
+
+char *flightrec_path;
+void (*flightrec_wake)(void);
+
+static char *fr_why;            /* the pending dump's reason */
+static time_t fr_last_auto;
+
+static unsigned long long
+now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* 'name' gives the default dump path, in FR_DIR */
+void
+flightrec_init(char *name)
+{
+    static char path[128];
+
+    if (!flightrec_path) {
+        snprintf(path, sizeof(path), "%s/%s-flight", FR_DIR, name);
+        flightrec_path = path;
+    }
+    fr_now = now_usec();
+}
+
+/* called once per tty read -- the words that follow share the time */
+unsigned long long
+flightrec_stamp(void)
+{
+    fr_now = now_usec();
+    return fr_now;
+}
+
+/* for events that don't come with a tty read */
+void
+flightrec_event(int kind, int src, unsigned int val)
+{
+    fr_entry_t *e;
+
+    e = &fr_ring[__atomic_fetch_add(&fr_head, 1, __ATOMIC_RELAXED)
+                    & (FR_ENTRIES - 1)];
+    e->usec = now_usec();
+    e->val = val;
+    e->kind = kind;
+    e->src = src;
+}
+
+static int
+fr_format(char *buf, int size, fr_entry_t *e, unsigned long long newest)
+{
+    unsigned long long ago = newest > e->usec ? newest - e->usec : 0;
+    char *what;
+    int n;
+
+    n = snprintf(buf, size, "-%llu.%06llu %d ",
+            ago / 1000000, ago % 1000000, e->src);
+
+    switch (e->kind) {
+    case FR_WORD:
+        return n + snprintf(buf + n, size - n, "%s %u\n",
+                (e->val & 0x8000) ? "pulse" : "space", e->val & 0x7fff);
+    case FR_RESYNC:
+        return n + snprintf(buf + n, size - n, "resync %u\n", e->val);
+    case FR_OOB:
+        what = "oob";
+        break;
+    case FR_DROP:
+        what = "drop";
+        break;
+    case FR_KEY:
+        what = "code";
+        break;
+    default:
+        what = "badcode";
+        break;
+    }
+    return n + snprintf(buf + n, size - n, "%s 0x%04x\n", what, e->val);
+}
+
+/*
+ * ask for a dump.  automatic dumps (on resyncs, or decode errors) are
+ * limited to one every FR_AUTO_SECS, so a sick receiver can't fill
+ * the disk.  a request made while one is already pending is covered
+ * by that one.  safe from any thread, or (if not automatic) from a
+ * signal handler.
+ */
+void
+flightrec_request(char *why, int automatic)
+{
+    char *none = 0;
+    time_t now, last;
+
+    if (!flightrec_path)
+        return;
+
+    if (automatic) {
+        now = time(0);
+        last = __atomic_load_n(&fr_last_auto, __ATOMIC_RELAXED);
+        if (last && now - last < FR_AUTO_SECS)
+            return;
+        if (!__atomic_compare_exchange_n(&fr_last_auto, &last, now, 0,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return;
+    }
+
+    if (__atomic_compare_exchange_n(&fr_why, &none, why, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) && flightrec_wake)
+        flightrec_wake();
+}
+
+/* open a new dump file, refusing to follow or reuse anything there */
+static int
+fr_create(char *path, int size)
+{
+    static unsigned int seq;
+    time_t now = time(0);
+    struct tm tm;
+    int fd, tries;
+
+    localtime_r(&now, &tm);
+    for (tries = 0; tries < 10; tries++) {
+        snprintf(path, size, "%s-%04d%02d%02d-%02d%02d%02d-%u.rec",
+                flightrec_path, tm.tm_year + 1900, tm.tm_mon + 1,
+                tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, seq++);
+        fd = open(path, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC, 0644);
+        if (fd >= 0 || errno != EEXIST)
+            return fd;
+    }
+    return -1;
+}
+
+/*
+ * write out the last FR_SECS of the ring, if a dump has been asked
+ * for.  returns 1 if one was.  only one thread should call this.
+ */
+int
+flightrec_service(void)
+{
+    static fr_entry_t snap[FR_ENTRIES];
+    char path[160], buf[4096];
+    unsigned long long newest;
+    unsigned int head, i, n;
+    int fd, len = 0, saved_errno = errno;
+    char *why;
+
+    why = __atomic_exchange_n(&fr_why, 0, __ATOMIC_ACQ_REL);
+    if (!why)
+        return 0;
+
+    /* take a copy first, so the ring can keep moving */
+    head = __atomic_load_n(&fr_head, __ATOMIC_RELAXED);
+    n = head < FR_ENTRIES ? head : FR_ENTRIES;
+    for (i = 0; i < n; i++)
+        snap[i] = fr_ring[(head - n + i) & (FR_ENTRIES - 1)];
+    if (!n)
+        return 1;
+    newest = snap[n - 1].usec;
+
+    fd = fr_create(path, sizeof(path));
+    if (fd < 0) {
+        report("flight recorder: can't create %s: %s", path, strerror(errno));
+        errno = saved_errno;
+        return 1;
+    }
+
+    len = snprintf(buf, sizeof(buf), "# flight record (%s), newest entry "
+            "at %llu.%06llu\n", why, newest / 1000000, newest % 1000000);
+
+    for (i = 0; i < n; i++) {
+        if (snap[i].usec + FR_SECS * 1000000ULL < newest)
+            continue;
+        if (len > (int)sizeof(buf) - 80) {
+            if (write(fd, buf, len) != len)
+                break;
+            len = 0;
+        }
+        len += fr_format(buf + len, sizeof(buf) - len, &snap[i], newest);
+    }
+    if (len && write(fd, buf, len) != len)
+        report("flight recorder: writing %s: %s", path, strerror(errno));
+    close(fd);
+
+    report("flight recorder (%s): wrote %s", why, path);
+    errno = saved_errno;
+    return 1;
+}
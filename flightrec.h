@@ -0,0 +1,95 @@
+/*
+ * flightrec.h
+ *
+ * the flight recorder:  an always-on ring of the last several
+ * seconds of words from the device, along with the framer's and
+ * decoder's notable events, for dumping to a file when something
+ * goes wrong.  it's cheap enough to leave running -- each word costs
+ * a few stores, using a timestamp taken once per tty read.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#define FR_ENTRIES 8192         // NB!  power of 2
+#define FR_SECS 10              /* how far back a dump reaches */
+#define FR_AUTO_SECS 30         /* automatic dumps come no more often */
+#define FR_DIR "/var/log"       /* default home for dumps -- root's, not /tmp */
+
+/* what an entry records */
+enum {
+    FR_WORD,            /* a pulse or space, as received */
+    FR_OOB,             /* an out-of-band payload */
+    FR_DROP,            /* a word the framer threw away */
+    FR_RESYNC,          /* framer resync, value is bytes dropped */
+    FR_KEY,             /* decoder:  a good code */
+    FR_BADCODE,         /* decoder:  a code that made no sense */
+};
+
+typedef struct fr_entry {
+    unsigned long long usec;    /* CLOCK_MONOTONIC */
+    unsigned int val;
+    unsigned char kind;
+    unsigned char src;          /* which receiver */
+} fr_entry_t;
+
+extern fr_entry_t fr_ring[FR_ENTRIES];
+extern unsigned int fr_head;
+extern unsigned long long fr_now;
+
+/* dumps go to <path>-<time>-<n>.rec */
+extern char *flightrec_path;
+
+/*
+ * a dump is only requested where the trouble is seen -- that may be
+ * a signal handler, or a realtime thread -- and written later by
+ * flightrec_service(), from somewhere that can afford file i/o.  if
+ * set, flightrec_wake is called (it must be signal-safe) to get
+ * that done.
+ */
+extern void (*flightrec_wake)(void);
+
+void flightrec_init(char *name);
+unsigned long long flightrec_stamp(void);
+void flightrec_event(int kind, int src, unsigned int val);
+void flightrec_request(char *why, int automatic);
+int flightrec_service(void);
+
+/*
+ * record one entry, stamped with the time of the last
+ * flightrec_stamp().  the decoder thread may record events too, so
+ * slots are claimed atomically.
+ */
+static inline void
+flightrec_add(int kind, int src, unsigned int val)
+{
+    fr_entry_t *e;
+
+    e = &fr_ring[__atomic_fetch_add(&fr_head, 1, __ATOMIC_RELAXED)
+                    & (FR_ENTRIES - 1)];
+    e->usec = fr_now;
+    e->val = val;
+    e->kind = kind;
+    e->src = src;
+}
+
+#endif /* FLIGHTREC_H */
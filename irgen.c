@@ -0,0 +1,400 @@
+/*
+ * irgen.c
+ *
+ * synthetic IR, in the avrlirc firmware's format.  see irgen.h.
+ *
+ * all times here are in microseconds by the host's clock, except
+ * where they're marked as device ticks (1/16384 sec, by the device's
+ * clock, which runs fast by 'clock_err').  durations are taken from
+ * the edges' positions in device ticks, so rounding never adds up
+ * over a long stream, just as with the firmware's free-running timer.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "avrhost.h"
+#include "airboard.h"
+#include "irgen.h"
+
+#define OVERFLOW_TICKS (IRGEN_OVERFLOW_USEC * STAMP_HZ / 1e6)
+
+void
+irgen_init(irgen_t *g, irgen_fn out, void *arg)
+{
+    memset(g, 0, sizeof(*g));
+    g->out = out;
+    g->arg = arg;
+    g->level = 1;
+    g->seed = 1;
+}
+
+/* a cheap, repeatable random number, from 0 to 1 */
+static double
+irgen_random(irgen_t *g)
+{
+    unsigned int x = g->seed ? g->seed : 1;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    g->seed = x;
+    return x / 4294967296.0;
+}
+
+static double
+to_ticks(irgen_t *g, double usec)
+{
+    return usec * (1 + g->clock_err) * STAMP_HZ / 1e6;
+}
+
+static double
+to_usec(irgen_t *g, double ticks)
+{
+    return ticks / (1 + g->clock_err) / STAMP_HZ * 1e6;
+}
+
+/* send one word, perhaps losing a byte or two of it */
+static void
+put_word(irgen_t *g, unsigned short w, double usec)
+{
+    unsigned char b[2];
+    int n = 0;
+
+    g->words++;
+
+    if (g->loss_rate && irgen_random(g) < g->loss_rate)
+        g->lost++;
+    else
+        b[n++] = w & 0xff;
+
+    if (g->loss_rate && irgen_random(g) < g->loss_rate)
+        g->lost++;
+    else
+        b[n++] = w >> 8;
+
+    g->bytes += n;
+    if (n)
+        g->out(g->arg, b, n, usec);
+}
+
+/* the firmware's tx_stamp() */
+static void
+put_stamp(irgen_t *g, double ticks, double usec)
+{
+    unsigned long stamp = (unsigned long)ticks;
+
+    if (g->nostamps)
+        return;
+
+    put_word(g, 0, usec);
+    put_word(g, OOB_TIME_LO | (stamp & 0xfff), usec);
+    put_word(g, 0, usec);
+    put_word(g, OOB_TIME_HI | ((stamp >> 12) & 0xfff), usec);
+}
+
+/*
+ * a run of 'ticks' at the current level, which ended at 'usec'.
+ * a glitch splits it in three, with a short blip of the other level
+ * in the middle.
+ */
+static void
+put_run(irgen_t *g, long ticks, double usec)
+{
+    unsigned short hi = g->level ? 0x8000 : 0;
+    long first, blip;
+
+    if (ticks > 0x7fff)
+        ticks = 0x7fff;
+    else if (ticks < 1)
+        ticks = 1;
+
+    if (g->glitch_rate && ticks > 2 * IRGEN_GLITCH_TICKS + 2 &&
+            irgen_random(g) < g->glitch_rate) {
+        blip = 1 + (long)(irgen_random(g) * IRGEN_GLITCH_TICKS);
+        first = 1 + (long)(irgen_random(g) * (ticks - blip - 2));
+        put_word(g, hi | first, usec);
+        put_word(g, (hi ^ 0x8000) | blip, usec);
+        put_word(g, hi | (ticks - first - blip), usec);
+        g->glitches++;
+        return;
+    }
+
+    put_word(g, hi | ticks, usec);
+}
+
+/*
+ * heartbeats, for each timer1 overflow between the last edge and
+ * 'usec'.  the firmware sends one, and a timestamp, at each.
+ */
+static void
+catch_up(irgen_t *g, double usec)
+{
+    double t;
+
+    if (!g->words)
+        return;         /* nothing's started yet */
+
+    while (1) {
+        t = g->edge_dev + (g->overflows + 1) * OVERFLOW_TICKS;
+        if (t > to_ticks(g, usec))
+            break;
+        g->overflows++;
+        put_word(g, 0, to_usec(g, t));
+        put_word(g, OOB_HEARTBEAT | (g->heartbeat_seq++ & 0xfff),
+                to_usec(g, t));
+        put_stamp(g, t, to_usec(g, t));
+    }
+}
+
+/* an edge, ending the current run, at about 'usec' */
+static void
+irgen_edge(irgen_t *g, double usec)
+{
+    double err = 0, dev;
+
+    if (g->jitter) {
+        err = (2 * irgen_random(g) - 1) * g->jitter;
+        /* edges can't pass each other */
+        if (usec + err <= g->edge + 1)
+            err = g->edge + 1 - usec;
+    }
+    usec += err;
+    dev = to_ticks(g, usec);
+
+    catch_up(g, usec);
+
+    if (!g->words || g->overflows) {
+        /* the remnant of a long quiet spell isn't timed.  there's
+         * the overflow word instead, and the burst's start time. */
+        put_word(g, g->level ? 0xffff : 0x7fff, usec);
+        put_stamp(g, dev, usec);
+    } else {
+        put_run(g, (long)floor(dev) - (long)floor(g->edge_dev), usec);
+    }
+
+    g->edge = usec;
+    g->edge_dev = dev;
+    g->overflows = 0;
+}
+
+/* the line is 'high' (idle, no carrier), or not, for 'usec' */
+void
+irgen_level(irgen_t *g, int high, double usec)
+{
+    if (high != g->level) {
+        irgen_edge(g, g->now);
+        g->level = high;
+    }
+    g->now += usec;
+    catch_up(g, g->now);
+}
+
+void
+irgen_gap(irgen_t *g, double usec)
+{
+    irgen_level(g, 1, usec);
+}
+
+#define mark(g, usec) irgen_level(g, 0, usec)
+#define space(g, usec) irgen_level(g, 1, usec)
+
+/* idle out the rest of a frame that began at 'start' */
+static void
+frame_end(irgen_t *g, double start, double period)
+{
+    if (g->now < start + period)
+        space(g, start + period - g->now);
+}
+
+/*
+ * NEC:  a 9ms mark, a 4.5ms space, then 32 bits, lsb first -- the
+ * address, its inverse (unless it's a 16 bit address), the command,
+ * and its inverse.  a 1 has a long space after its mark.  each
+ * repeat is a short "still held" frame.
+ */
+#define NEC_UNIT 562.5
+#define NEC_PERIOD 108000.0
+
+void
+irgen_nec(irgen_t *g, int addr, int cmd, int repeats)
+{
+    unsigned long bits;
+    double start = g->now;
+    int i;
+
+    if (addr > 0xff)
+        bits = addr & 0xffff;
+    else
+        bits = addr | (~addr & 0xff) << 8;
+    bits |= (unsigned long)(cmd & 0xff) << 16;
+    bits |= (unsigned long)(~cmd & 0xff) << 24;
+
+    mark(g, 16 * NEC_UNIT);
+    space(g, 8 * NEC_UNIT);
+    for (i = 0; i < 32; i++) {
+        mark(g, NEC_UNIT);
+        space(g, ((bits >> i) & 1) ? 3 * NEC_UNIT : NEC_UNIT);
+    }
+    mark(g, NEC_UNIT);
+    frame_end(g, start, NEC_PERIOD);
+
+    while (repeats--) {
+        start = g->now;
+        mark(g, 16 * NEC_UNIT);
+        space(g, 4 * NEC_UNIT);
+        mark(g, NEC_UNIT);
+        frame_end(g, start, NEC_PERIOD);
+    }
+}
+
+/*
+ * RC5:  14 manchester coded bits, msb first -- two start bits (the
+ * second is the inverse of command bit 6, in extended RC5), the
+ * toggle, a 5 bit address, and a 6 bit command.  a 1 is a space
+ * then a mark.
+ */
+#define RC5_HALF 889.0
+#define RC5_PERIOD 113778.0
+
+void
+irgen_rc5(irgen_t *g, int addr, int cmd, int toggle)
+{
+    unsigned int bits;
+    double start = g->now;
+    int i;
+
+    bits = 1 << 13 | (!(cmd & 0x40)) << 12 | (!!toggle) << 11 |
+            (addr & 0x1f) << 6 | (cmd & 0x3f);
+
+    for (i = 13; i >= 0; i--) {
+        if ((bits >> i) & 1) {
+            space(g, RC5_HALF);
+            mark(g, RC5_HALF);
+        } else {
+            mark(g, RC5_HALF);
+            space(g, RC5_HALF);
+        }
+    }
+    frame_end(g, start, RC5_PERIOD);
+}
+
+/*
+ * RC6, mode 0:  a leader, a start bit, three mode bits, a double
+ * length toggle ("trailer") bit, then an 8 bit address and 8 bit
+ * command, msb first.  a 1 is a mark then a space -- the opposite
+ * of RC5.
+ */
+#define RC6_UNIT 444.444
+#define RC6_PERIOD 106667.0
+
+static void
+rc6_bit(irgen_t *g, int bit, double len)
+{
+    if (bit) {
+        mark(g, len);
+        space(g, len);
+    } else {
+        space(g, len);
+        mark(g, len);
+    }
+}
+
+void
+irgen_rc6(irgen_t *g, int addr, int cmd, int toggle)
+{
+    unsigned int bits;
+    double start = g->now;
+    int i;
+
+    mark(g, 6 * RC6_UNIT);
+    space(g, 2 * RC6_UNIT);
+    rc6_bit(g, 1, RC6_UNIT);
+    for (i = 0; i < 3; i++)
+        rc6_bit(g, 0, RC6_UNIT);
+    rc6_bit(g, toggle, 2 * RC6_UNIT);
+
+    bits = (addr & 0xff) << 8 | (cmd & 0xff);
+    for (i = 15; i >= 0; i--)
+        rc6_bit(g, (bits >> i) & 1, RC6_UNIT);
+    frame_end(g, start, RC6_PERIOD);
+}
+
+/*
+ * the airboard:  plain async serial, at AIRBOARD_BAUD.  a 0 start
+ * bit, the report msb first, and a 1 stop bit.  the line's idle
+ * state is 1, so a 0 is carrier.
+ */
+#define AB_BIT (1e6 / AIRBOARD_BAUD)
+
+static void
+airboard_report(irgen_t *g, unsigned long code, int len)
+{
+    int i;
+
+    irgen_level(g, 0, AB_BIT);
+    for (i = len - 1; i >= 0; i--)
+        irgen_level(g, (code >> i) & 1, AB_BIT);
+    irgen_level(g, 1, AB_BIT);
+}
+
+/* 'ir_code' is the press code, from keys[] */
+void
+irgen_airboard_key(irgen_t *g, long ir_code, int down)
+{
+    airboard_report(g, down ? ir_code : ir_code ^ IR_UP_MASK,
+            KEY_WORD_LEN);
+}
+
+/*
+ * one axis of a mouse report:  a 5 bit motion value (read
+ * backwards), then 3 direction bits.  the levels are the ones
+ * motion_level() in airboard-ir.c recognizes.
+ */
+static unsigned int
+mouse_axis(int level)
+{
+    static unsigned int motion[] = { 0x00, 0x04, 0x02, 0x06, 0x01 };
+    unsigned int m;
+
+    if (level > 4)
+        level = 4;
+    else if (level < -4)
+        level = -4;
+
+    if (level >= 0)
+        return motion[level] << 3;
+
+    m = ~motion[-level] & 0x1f;
+    return m << 3 | 0x7;
+}
+
+/* 'xlevel' and 'ylevel' are speeds, from -4 to 4 (left and up are < 0) */
+void
+irgen_airboard_mouse(irgen_t *g, int xlevel, int ylevel)
+{
+    unsigned long code;
+
+    code = (unsigned long)IR_MOUSE_PREFIX << 19 |
+            mouse_axis(xlevel) << 11 | 0x6 << 8 | mouse_axis(ylevel);
+    airboard_report(g, code, MOUSE_WORD_LEN);
+}
@@ -0,0 +1,91 @@
+/*
+ * irgen.h
+ *
+ * synthetic IR:  builds the byte stream an avrlirc device would send
+ * for NEC, RC5 and RC6 remotes, and for the airboard's key and mouse
+ * reports, with optional faults -- edge jitter, glitches, a device
+ * clock that's off, and lost bytes.  it's for driving avrlirc2udp
+ * and airboard-ir (see irsynth.c) at rates and fault levels that
+ * can't be produced by hand.
+ *
+ * the line is described as a series of levels and how long each
+ * lasts.  as in the firmware, a run is reported when the edge that
+ * ends it arrives, with 0x8000 set for the high (idle, no carrier)
+ * level.  a quiet spell of a timer1 overflow or more turns into
+ * heartbeats, and the next burst starts with the overflow word, and
+ * (unless 'nostamps' is set) a timestamp.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef IRGEN_H
+#define IRGEN_H
+
+/* the device's timer1 wraps (65536 counts at 31250Hz) this often */
+#define IRGEN_OVERFLOW_USEC 2097152.0
+
+#define IRGEN_GLITCH_TICKS 3    /* longest glitch we insert */
+
+/*
+ * bytes come out through 'out', along with the time (in usec from
+ * the start of the stream, by the host's clock) when the device
+ * would have sent them.
+ */
+typedef void (*irgen_fn)(void *arg, const unsigned char *buf, int n,
+        double usec);
+
+typedef struct irgen {
+    irgen_fn out;
+    void *arg;
+
+    /* faults, all off when zero */
+    double jitter;              /* usec -- each edge moves up to +/- this */
+    double clock_err;           /* device clock error, e.g. 0.02 is 2% fast */
+    double glitch_rate;         /* chance, per run, of a glitch in it */
+    double loss_rate;           /* chance of losing each byte */
+    int nostamps;               /* firmware without timestamps */
+    unsigned int seed;
+
+    /* private */
+    double now;                 /* usec, host time, at the end of the line */
+    double edge;                /* time of the last edge */
+    double edge_dev;            /* ...in device ticks */
+    int level;                  /* 1 is high -- idle */
+    int overflows;              /* timer1 wraps since the last edge */
+    unsigned int heartbeat_seq;
+
+    /* statistics */
+    unsigned long words;
+    unsigned long bytes;
+    unsigned long lost;
+    unsigned long glitches;
+} irgen_t;
+
+void irgen_init(irgen_t *g, irgen_fn out, void *arg);
+void irgen_level(irgen_t *g, int high, double usec);
+void irgen_gap(irgen_t *g, double usec);
+
+void irgen_nec(irgen_t *g, int addr, int cmd, int repeats);
+void irgen_rc5(irgen_t *g, int addr, int cmd, int toggle);
+void irgen_rc6(irgen_t *g, int addr, int cmd, int toggle);
+void irgen_airboard_key(irgen_t *g, long ir_code, int down);
+void irgen_airboard_mouse(irgen_t *g, int xlevel, int ylevel);
+
+#endif /* IRGEN_H */
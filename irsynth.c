@@ -0,0 +1,383 @@
+/*
+ * irsynth.c
+ *
+ * makes up IR, as an avrlirc device would send it (see irgen.h),
+ * for exercising avrlirc2udp and airboard-ir without pressing real
+ * buttons.  the output goes to stdout, a file, or a pseudo-tty that
+ * either daemon can be pointed at with '-t', and is paced in real
+ * time (or faster, or not at all).
+ *
+ * what to send is given as a list of items (on the command line, or
+ * on stdin if there are none):
+ *
+ *   nec:<addr>:<cmd>[:<repeats>]
+ *   rc5:<addr>:<cmd>           (the toggle bit flips each time)
+ *   rc6:<addr>:<cmd>           (ditto)
+ *   key:<name>                 airboard press and release, by the
+ *   down:<name>                  names in airboard-keys.c
+ *   up:<name>
+ *   mouse:<x>:<y>[:<count>]    airboard mouse reports, speeds -4 to 4
+ *   gap:<ms>                   extra quiet time
+ *
+ * each item is followed by '-g' milliseconds of quiet.  numbers may
+ * be in hex.  for example:
+ *   irsynth -P -j 60 -c 3 -L 0 nec:4:8:2 key:key_a mouse:2:-1:10
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "avrhost.h"
+#include "airboard.h"
+#include "irgen.h"
+
+#define GAP_MS 100              /* default quiet time after each item */
+#define KEY_HOLD_MS 80          /* between press and release, for key: */
+#define MOUSE_IDLE_BITS 4       /* between mouse reports */
+#define PACE_SLOP_USEC 200      /* don't sleep for less than this */
+#define MAX_ITEMS 256
+
+char *me;
+
+irgen_t gen;
+int out_fd = 1;
+double speed = 1.0;             /* 0 for no pacing */
+struct timespec start;
+
+int rc5_toggle, rc6_toggle;
+int gap_ms = GAP_MS;
+
+void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: %s [options] item...\n"
+        "  items:\n"
+        "    nec:<addr>:<cmd>[:<repeats>], rc5:<addr>:<cmd>, rc6:<addr>:<cmd>\n"
+        "    key:<name>, down:<name>, up:<name>  (airboard keys)\n"
+        "    mouse:<x>:<y>[:<count>]  (airboard, speeds -4 to 4)\n"
+        "    gap:<ms>\n"
+        "    if no items are given, they're read from stdin.\n"
+        "  output options:\n"
+        "    '-o <file>' to write to a file, rather than stdout.\n"
+        "    '-P' to create a pseudo-tty, and write to that.  its name\n"
+        "        is printed, for giving to the daemons' '-t'.\n"
+        "    '-D <S>' to wait S seconds before starting (default 2 with -P).\n"
+        "    '-x <N>' to run N times faster than real time (0 for\n"
+        "        no pacing at all).\n"
+        "    '-L <N>' to repeat the items N times (0 for forever).\n"
+        "    '-g <ms>' quiet time after each item (default %d).\n"
+        "    '-T' for no timestamps (older firmware).\n"
+        "  fault options:\n"
+        "    '-j <usec>' to move each edge randomly, up to +/- usec.\n"
+        "    '-c <pct>' to make the device's clock fast (or slow, if\n"
+        "        negative) by pct percent.\n"
+        "    '-e <rate>' chance of a glitch in each run (e.g. 0.01).\n"
+        "    '-l <rate>' chance of losing each byte (e.g. 0.001).\n"
+        "    '-s <seed>' for a different (repeatable) set of faults.\n"
+        , me, GAP_MS);
+    exit(1);
+}
+
+void
+report(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    fprintf(stderr, "%s: ", me);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+void
+die(const char *fmt, ...)
+{
+    va_list ap;
+    int e = errno;
+
+    va_start(ap, fmt);
+    fprintf(stderr, "%s: ", me);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, " - %s\n", strerror(e));
+    va_end(ap);
+    exit(1);
+}
+
+/* sleep until 'usec' into the stream, allowing for the speedup */
+static void
+pace(double usec)
+{
+    struct timespec now, t;
+    double ns;
+
+    if (speed <= 0)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = usec * 1000 / speed;
+    ns -= (now.tv_sec - start.tv_sec) * 1e9 + (now.tv_nsec - start.tv_nsec);
+    if (ns < PACE_SLOP_USEC * 1000)
+        return;
+
+    t = now;
+    t.tv_sec += (time_t)(ns / 1e9);
+    t.tv_nsec += (long)(ns - (time_t)(ns / 1e9) * 1e9);
+    if (t.tv_nsec >= 1000000000) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, 0) == EINTR)
+        ;
+}
+
+static void
+emit(void *arg, const unsigned char *buf, int n, double usec)
+{
+    int w;
+
+    pace(usec);
+    while (n > 0) {
+        w = write(out_fd, buf, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            die("write");
+        }
+        buf += w;
+        n -= w;
+    }
+}
+
+/* a pseudo-tty, in raw mode, so nothing is echoed or translated */
+static int
+open_pty(void)
+{
+    struct termios tios;
+    int fd, slave;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0)
+        die("creating pty");
+
+    /* keep the slave open ourselves, so our writes don't fail
+     * while the daemon reopens it */
+    slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+    if (slave < 0)
+        die("opening %s", ptsname(fd));
+    if (tcgetattr(slave, &tios) < 0)
+        die("tcgetattr");
+    cfmakeraw(&tios);
+    if (tcsetattr(slave, TCSANOW, &tios) < 0)
+        die("tcsetattr");
+
+    printf("%s\n", ptsname(fd));
+    fflush(stdout);
+    return fd;
+}
+
+static long
+number(char *s)
+{
+    char *e;
+    long n;
+
+    if (!s)
+        usage();
+    n = strtol(s, &e, 0);
+    if (*e)
+        usage();
+    return n;
+}
+
+static key_desc_t *
+airboard_key(char *name)
+{
+    key_desc_t *keyp = name ? key_by_name(name) : 0;
+
+    if (!keyp) {
+        fprintf(stderr, "%s: no airboard key named '%s'\n", me,
+                name ? name : "");
+        usage();
+    }
+    return keyp;
+}
+
+/*
+ * send one item.  'item' is parsed in place, so it's restored
+ * afterward, for the next time around.
+ */
+static void
+do_item(char *item)
+{
+    char buf[128], *what, *a, *b, *c;
+    int i, n;
+
+    snprintf(buf, sizeof(buf), "%s", item);
+    what = strtok(buf, ":");
+    a = strtok(0, ":");
+    b = strtok(0, ":");
+    c = strtok(0, ":");
+    if (!what)
+        usage();
+
+    if (!strcmp(what, "nec")) {
+        irgen_nec(&gen, number(a), number(b), c ? number(c) : 0);
+    } else if (!strcmp(what, "rc5")) {
+        irgen_rc5(&gen, number(a), number(b), rc5_toggle);
+        rc5_toggle = !rc5_toggle;
+    } else if (!strcmp(what, "rc6")) {
+        irgen_rc6(&gen, number(a), number(b), rc6_toggle);
+        rc6_toggle = !rc6_toggle;
+    } else if (!strcmp(what, "key")) {
+        irgen_airboard_key(&gen, airboard_key(a)->ir_code, 1);
+        irgen_gap(&gen, KEY_HOLD_MS * 1000.0);
+        irgen_airboard_key(&gen, airboard_key(a)->ir_code, 0);
+    } else if (!strcmp(what, "down")) {
+        irgen_airboard_key(&gen, airboard_key(a)->ir_code, 1);
+    } else if (!strcmp(what, "up")) {
+        irgen_airboard_key(&gen, airboard_key(a)->ir_code, 0);
+    } else if (!strcmp(what, "mouse")) {
+        n = c ? number(c) : 1;
+        for (i = 0; i < n; i++) {
+            irgen_airboard_mouse(&gen, number(a), number(b));
+            irgen_gap(&gen, MOUSE_IDLE_BITS * 1e6 / AIRBOARD_BAUD);
+        }
+    } else if (!strcmp(what, "gap")) {
+        irgen_gap(&gen, number(a) * 1000.0);
+    } else {
+        fprintf(stderr, "%s: unknown item '%s'\n", me, item);
+        usage();
+    }
+
+    irgen_gap(&gen, gap_ms * 1000.0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static char *stdin_items[MAX_ITEMS];
+    char **items, word[128], *p;
+    int nitems, loops = 1, loop, c, i;
+    int use_pty = 0;
+    double delay = -1;
+
+    me = argv[0];
+    p = strrchr(argv[0], '/');
+    if (p) me = p + 1;
+
+    irgen_init(&gen, emit, 0);
+
+    while ((c = getopt(argc, argv, "o:PD:x:L:g:Tj:c:e:l:s:")) != EOF) {
+        switch (c) {
+        case 'o':
+            out_fd = open(optarg, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+            if (out_fd < 0)
+                die("opening %s", optarg);
+            break;
+        case 'P':
+            use_pty = 1;
+            break;
+        case 'D':
+            delay = atof(optarg);
+            break;
+        case 'x':
+            speed = atof(optarg);
+            break;
+        case 'L':
+            loops = atoi(optarg);
+            break;
+        case 'g':
+            gap_ms = atoi(optarg);
+            break;
+        case 'T':
+            gen.nostamps = 1;
+            break;
+        case 'j':
+            gen.jitter = atof(optarg);
+            break;
+        case 'c':
+            gen.clock_err = atof(optarg) / 100;
+            if (gen.clock_err <= -0.5 || gen.clock_err >= 0.5)
+                usage();
+            break;
+        case 'e':
+            gen.glitch_rate = atof(optarg);
+            break;
+        case 'l':
+            gen.loss_rate = atof(optarg);
+            break;
+        case 's':
+            gen.seed = strtoul(optarg, 0, 0);
+            break;
+        default:
+            usage();
+            break;
+        }
+    }
+
+    if (optind < argc) {
+        items = &argv[optind];
+        nitems = argc - optind;
+    } else {
+        items = stdin_items;
+        for (nitems = 0; nitems < MAX_ITEMS &&
+                scanf("%127s", word) == 1; nitems++)
+            items[nitems] = strdup(word);
+    }
+    if (!nitems)
+        usage();
+
+    if (use_pty) {
+        out_fd = open_pty();
+        if (delay < 0)
+            delay = 2;
+    }
+    if (delay > 0)
+        usleep(delay * 1000000);
+
+    /* a reader going away is an ordinary way to stop */
+    signal(SIGPIPE, SIG_IGN);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (loop = 0; !loops || loop < loops; loop++)
+        for (i = 0; i < nitems; i++)
+            do_item(items[i]);
+
+    report("%lu words, %lu bytes sent, %lu lost, %lu glitches",
+            gen.words, gen.bytes, gen.lost, gen.glitches);
+
+    /* with a pty, give the reader a moment to drain it */
+    if (use_pty)
+        sleep(1);
+    return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * lirccuse.c
+ *
+ * a /dev/lirc-style mode2 device, served from userspace via CUSE.
+ *
+ * lircd (with its "default" driver), ir-ctl, mode2, and friends can
+ * open the device and read it just as they would a kernel LIRC
+ * receiver:  reads return 32 bit mode2 samples (pulse or space, plus
+ * a duration in microseconds), block until there's data (unless
+ * O_NONBLOCK), and poll() works.  the LIRC_GET_FEATURES,
+ * LIRC_GET_REC_MODE, LIRC_SET_REC_MODE and LIRC_GET_REC_RESOLUTION
+ * ioctls are supported.
+ *
+ * there's a single sample fifo, so it's really meant for one
+ * reader at a time.  if nobody's reading, the oldest samples are
+ * discarded.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#define FUSE_USE_VERSION 31
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <linux/lirc.h>
+#include <fuse_lowlevel.h>
+#include <cuse_lowlevel.h>
+
+#include "avrhost.h"
+#include "lirccuse.h"
+
+#define LIRCCUSE_MASK (LIRCCUSE_FIFO - 1)
+
+/* avrlirc durations are in 1/16384ths of a second */
+#define TICK_USEC(t) ((uint32_t)(t) * 1000000 / 16384)
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t fifo[LIRCCUSE_FIFO];
+static unsigned int fifo_r, fifo_w;
+static unsigned long overruns;
+
+/*
+ * a blocked read, and a poller, waiting for data.  the session
+ * loop is single-threaded, so only lirccuse_put() races with it.
+ */
+static fuse_req_t pending_req;
+static size_t pending_size;
+static struct fuse_pollhandle *pending_ph;
+
+static struct fuse_session *session;
+
+/* call with the lock held.  returns the number of bytes copied. */
+static size_t
+fifo_take(uint32_t *buf, size_t size)
+{
+    size_t n = 0;
+
+    while (fifo_r != fifo_w && n + sizeof(uint32_t) <= size) {
+        buf[n / sizeof(uint32_t)] = fifo[fifo_r & LIRCCUSE_MASK];
+        fifo_r++;
+        n += sizeof(uint32_t);
+    }
+    return n;
+}
+
+/* call with the lock held */
+static void
+reply_pending(void)
+{
+    uint32_t buf[LIRCCUSE_FIFO];
+    size_t n;
+
+    if (pending_req) {
+        n = fifo_take(buf, pending_size);
+        fuse_reply_buf(pending_req, (char *)buf, n);
+        pending_req = 0;
+    }
+    if (pending_ph) {
+        fuse_lowlevel_notify_poll(pending_ph);
+        fuse_pollhandle_destroy(pending_ph);
+        pending_ph = 0;
+    }
+}
+
+/* called from the relay for each IR word */
+void
+lirccuse_put(unsigned short w)
+{
+    uint32_t sample;
+
+    if (w & 0x8000)
+        sample = LIRC_PULSE(TICK_USEC(w & 0x7fff));
+    else
+        sample = LIRC_SPACE(TICK_USEC(w & 0x7fff));
+
+    pthread_mutex_lock(&lock);
+    if (fifo_w - fifo_r == LIRCCUSE_FIFO) {
+        fifo_r++;   /* drop the oldest */
+        if (overruns++ % 1000 == 0)
+            report("lirc device: no reader, samples discarded");
+    }
+    fifo[fifo_w++ & LIRCCUSE_MASK] = sample;
+    reply_pending();
+    pthread_mutex_unlock(&lock);
+}
+
+static void
+lc_open(fuse_req_t req, struct fuse_file_info *fi)
+{
+    fi->nonseekable = 1;
+    fi->direct_io = 1;
+    fuse_reply_open(req, fi);
+}
+
+/*
+ * the reader was signalled while blocked.  this may be called from
+ * fuse_req_interrupt_func(), so it mustn't be holding the lock.
+ */
+static void
+lc_interrupt(fuse_req_t req, void *data)
+{
+    pthread_mutex_lock(&lock);
+    if (pending_req == req) {
+        fuse_reply_err(req, EINTR);
+        pending_req = 0;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void
+lc_read(fuse_req_t req, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    uint32_t buf[LIRCCUSE_FIFO];
+    size_t n;
+
+    if (size < sizeof(uint32_t)) {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    if (size > sizeof(buf))
+        size = sizeof(buf);
+
+    fuse_req_interrupt_func(req, lc_interrupt, 0);
+
+    pthread_mutex_lock(&lock);
+    if (fifo_r != fifo_w) {
+        n = fifo_take(buf, size);
+        fuse_reply_buf(req, (char *)buf, n);
+    } else if (fi->flags & O_NONBLOCK) {
+        fuse_reply_err(req, EAGAIN);
+    } else if (pending_req) {
+        fuse_reply_err(req, EBUSY);     /* one blocked reader at a time */
+    } else if (fuse_req_interrupted(req)) {
+        fuse_reply_err(req, EINTR);
+    } else {
+        /* answered later, from lirccuse_put() */
+        pending_req = req;
+        pending_size = size;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void
+lc_poll(fuse_req_t req, struct fuse_file_info *fi, struct fuse_pollhandle *ph)
+{
+    unsigned revents = 0;
+
+    pthread_mutex_lock(&lock);
+    if (fifo_r != fifo_w)
+        revents = POLLIN | POLLRDNORM;
+    if (ph) {
+        if (pending_ph)
+            fuse_pollhandle_destroy(pending_ph);
+        pending_ph = ph;
+    }
+    pthread_mutex_unlock(&lock);
+
+    fuse_reply_poll(req, revents);
+}
+
+static void
+lc_ioctl(fuse_req_t req, int cmd, void *arg, struct fuse_file_info *fi,
+        unsigned flags, const void *in_buf, size_t in_bufsz, size_t out_bufsz)
+{
+    struct iovec iov = { arg, sizeof(uint32_t) };
+    uint32_t val;
+
+    switch ((unsigned)cmd) {
+    case LIRC_GET_FEATURES:
+    case LIRC_GET_REC_MODE:
+    case LIRC_GET_REC_RESOLUTION:
+        /* first time through, ask the kernel for somewhere to write */
+        if (!out_bufsz) {
+            fuse_reply_ioctl_retry(req, 0, 0, &iov, 1);
+            return;
+        }
+        if (cmd == LIRC_GET_FEATURES)
+            val = LIRC_CAN_REC_MODE2;
+        else if (cmd == LIRC_GET_REC_MODE)
+            val = LIRC_MODE_MODE2;
+        else
+            val = TICK_USEC(1);
+        fuse_reply_ioctl(req, 0, &val, sizeof(val));
+        return;
+
+    case LIRC_SET_REC_MODE:
+        if (!in_bufsz) {
+            fuse_reply_ioctl_retry(req, &iov, 1, 0, 0);
+            return;
+        }
+        memcpy(&val, in_buf, sizeof(val));
+        if (val != LIRC_MODE_MODE2) {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+        fuse_reply_ioctl(req, 0, 0, 0);
+        return;
+
+    default:
+        fuse_reply_err(req, ENOTTY);
+        return;
+    }
+}
+
+static const struct cuse_lowlevel_ops lc_ops = {
+    .open = lc_open,
+    .read = lc_read,
+    .poll = lc_poll,
+    .ioctl = lc_ioctl,
+};
+
+static void *
+lirccuse_loop(void *arg)
+{
+    fuse_session_loop(session);
+    report("lirc device session ended");
+    return 0;
+}
+
+/*
+ * create /dev/<devname>, and start serving it from its own thread.
+ * must be called after daemonizing, since threads don't survive
+ * the fork.  libfuse installs its own signal handlers, so the
+ * caller should (re)install its own afterward.
+ */
+void
+lirccuse_start(char *devname)
+{
+    static char devarg[128];
+    const char *dev_info_argv[] = { devarg };
+    char *argv[] = { "avrlirc", "-f", 0 };
+    struct cuse_info ci;
+    int multithreaded;
+    pthread_t tid;
+
+    snprintf(devarg, sizeof(devarg), "DEVNAME=%s", devname);
+
+    memset(&ci, 0, sizeof(ci));
+    ci.dev_info_argc = 1;
+    ci.dev_info_argv = dev_info_argv;
+    ci.flags = CUSE_UNRESTRICTED_IOCTL;
+
+    session = cuse_lowlevel_setup(2, argv, &ci, &lc_ops, &multithreaded, 0);
+    if (!session)
+        die("unable to create /dev/%s", devname);
+
+    if (pthread_create(&tid, 0, lirccuse_loop, 0))
+        die("unable to start lirc device thread");
+    pthread_detach(tid);
+
+    report("serving mode2 data on /dev/%s", devname);
+}
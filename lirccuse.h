@@ -0,0 +1,37 @@
+/*
+ * lirccuse.h
+ *
+ * present the avrlirc pulse stream as a kernel-style LIRC "mode2"
+ * character device, using CUSE (character devices in userspace).
+ * only built if USE_CUSE is set -- it needs libfuse3.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef LIRCCUSE_H
+#define LIRCCUSE_H
+
+/* samples buffered for a slow (or absent) reader */
+#define LIRCCUSE_FIFO 1024      // NB!  power of 2
+
+void lirccuse_start(char *devname);
+void lirccuse_put(unsigned short w);
+
+#endif /* LIRCCUSE_H */
@@ -0,0 +1,234 @@
+/*
+ * pulseshm.c
+ *
+ * shared memory pulse ring.  see pulseshm.h.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "avrhost.h"
+#include "pulseshm.h"
+
+static int
+futex(_Atomic uint32_t *addr, int op, uint32_t val, struct timespec *to)
+{
+    return syscall(SYS_futex, (uint32_t *)addr, op, val, to, 0, 0);
+}
+
+static char *
+shm_path(char *name)
+{
+    static char path[256];
+
+    snprintf(path, sizeof(path), "/%s", name);
+    return path;
+}
+
+/*
+ * create (or re-attach to) the named segment.  if a compatible
+ * segment is already there, its sequence number carries on, so
+ * readers that outlive a restart of the relay don't get confused.
+ */
+pulseshm_t *
+pulseshm_create(char *name)
+{
+    pulseshm_t *shm;
+    int fd;
+
+    fd = shm_open(shm_path(name), O_RDWR|O_CREAT, 0660);
+    if (fd < 0)
+        die("shm_open of %s", name);
+
+    if (ftruncate(fd, sizeof(*shm)) < 0)
+        die("ftruncate of %s", name);
+
+    shm = mmap(0, sizeof(*shm), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED)
+        die("mmap of %s", name);
+    close(fd);
+
+    if (shm->magic != PULSESHM_MAGIC || shm->version != PULSESHM_VERSION ||
+            shm->nwords != PULSESHM_WORDS) {
+        memset(shm, 0, sizeof(*shm));
+        shm->nwords = PULSESHM_WORDS;
+        shm->version = PULSESHM_VERSION;
+        shm->magic = PULSESHM_MAGIC;
+    }
+
+    return shm;
+}
+
+/* add a word.  readers aren't woken until pulseshm_flush(). */
+void
+pulseshm_put(pulseshm_t *shm, unsigned short w)
+{
+    uint64_t head = atomic_load_explicit(&shm->head, memory_order_relaxed);
+
+    shm->words[head & PULSESHM_MASK] = w;
+    atomic_store_explicit(&shm->head, head + 1, memory_order_release);
+}
+
+/*
+ * the fence keeps the head stores above from passing the load of
+ * 'waiters'.  without it a reader could count itself in, see the
+ * old head, and sleep through the words we just put.  (the reader's
+ * side is all seq_cst, which pairs with this.)
+ */
+void
+pulseshm_flush(pulseshm_t *shm)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&shm->waiters)) {
+        atomic_fetch_add(&shm->wake_seq, 1);
+        futex(&shm->wake_seq, FUTEX_WAKE, INT_MAX, 0);
+    }
+}
+
+/*
+ * attach to an existing segment.  reading starts with the next word
+ * published.  returns 0, or -1 if there's no usable segment.
+ */
+int
+pulseshm_open(pulseshm_reader_t *r, char *name)
+{
+    struct stat st;
+    pulseshm_t *shm;
+    int fd;
+
+    memset(r, 0, sizeof(*r));
+
+    fd = shm_open(shm_path(name), O_RDWR, 0);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(*shm)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    shm = mmap(0, sizeof(*shm), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+        return -1;
+
+    if (shm->magic != PULSESHM_MAGIC || shm->version != PULSESHM_VERSION ||
+            shm->nwords != PULSESHM_WORDS) {
+        munmap(shm, sizeof(*shm));
+        errno = EINVAL;
+        return -1;
+    }
+
+    r->shm = shm;
+    r->cursor = atomic_load_explicit(&shm->head, memory_order_acquire);
+    return 0;
+}
+
+/*
+ * point at the unread words, in place.  returns how many there are
+ * (only as many as are contiguous in the ring -- there may be more
+ * after those are consumed).
+ */
+int
+pulseshm_peek(pulseshm_reader_t *r, const uint16_t **wordsp)
+{
+    uint64_t head;
+    int avail, idx;
+
+    head = atomic_load_explicit(&r->shm->head, memory_order_acquire);
+
+    /* if we've been lapped, skip ahead to the oldest word that's
+     * safely out of the producer's way.
+     */
+    if (head - r->cursor >= PULSESHM_WORDS) {
+        r->lost += head - PULSESHM_WORDS / 2 - r->cursor;
+        r->cursor = head - PULSESHM_WORDS / 2;
+    }
+
+    idx = r->cursor & PULSESHM_MASK;
+    avail = head - r->cursor;
+    if (avail > PULSESHM_WORDS - idx)
+        avail = PULSESHM_WORDS - idx;
+
+    *wordsp = &r->shm->words[idx];
+    return avail;
+}
+
+/*
+ * done with n of the words from pulseshm_peek().  returns n, or -1
+ * if the producer may have overwritten them while we were looking,
+ * in which case they should be discarded (they've been counted as
+ * lost).
+ */
+int
+pulseshm_consume(pulseshm_reader_t *r, int n)
+{
+    uint64_t head;
+
+    /* our reads of the words must happen before we recheck head */
+    atomic_thread_fence(memory_order_acquire);
+    head = atomic_load_explicit(&r->shm->head, memory_order_relaxed);
+
+    r->cursor += n;
+    if (head - (r->cursor - n) >= PULSESHM_WORDS) {
+        r->lost += n;
+        return -1;
+    }
+    return n;
+}
+
+/*
+ * wait for words to arrive.  timeout_ms < 0 waits forever.  returns
+ * 1 if there's something to read, 0 otherwise.
+ */
+int
+pulseshm_wait(pulseshm_reader_t *r, int timeout_ms)
+{
+    pulseshm_t *shm = r->shm;
+    struct timespec ts, *tsp = 0;
+    uint32_t seq;
+
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        tsp = &ts;
+    }
+
+    atomic_fetch_add(&shm->waiters, 1);
+    seq = atomic_load(&shm->wake_seq);
+    if (atomic_load(&shm->head) == r->cursor)
+        futex(&shm->wake_seq, FUTEX_WAIT, seq, tsp);
+    atomic_fetch_sub(&shm->waiters, 1);
+
+    return atomic_load(&shm->head) != r->cursor;
+}
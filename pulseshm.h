@@ -0,0 +1,77 @@
+/*
+ * pulseshm.h
+ *
+ * a single-producer, multi-consumer ring of avrlirc words in a
+ * POSIX shared memory segment.  the relay publishes every word it
+ * receives, and any number of local programs can follow along,
+ * reading directly out of the shared segment.
+ *
+ * the producer never waits for readers.  each reader keeps its own
+ * cursor, in its own memory, so adding a reader costs the producer
+ * nothing.  a reader that falls more than a ring's worth behind
+ * simply loses the oldest words, and is told how many.  readers
+ * that want to block do so on a futex in the segment, and the
+ * producer only makes the wakeup call when someone is waiting.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef PULSESHM_H
+#define PULSESHM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define PULSESHM_MAGIC   0x4c525641     /* "AVRL" */
+#define PULSESHM_VERSION 1
+#define PULSESHM_WORDS   4096           // NB!  power of 2
+#define PULSESHM_MASK    (PULSESHM_WORDS - 1)
+
+/* the layout of the shared segment */
+typedef struct pulseshm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nwords;
+    uint32_t pad;
+    _Atomic uint64_t head;          /* sequence number of next word */
+    _Atomic uint32_t wake_seq;      /* the futex */
+    _Atomic uint32_t waiters;       /* readers blocked on the futex */
+    uint16_t words[PULSESHM_WORDS];
+} pulseshm_t;
+
+/* a reader's private view */
+typedef struct pulseshm_reader {
+    pulseshm_t *shm;
+    uint64_t cursor;                /* sequence number of next word */
+    unsigned long lost;             /* words overwritten before we saw them */
+} pulseshm_reader_t;
+
+/* producer side */
+pulseshm_t *pulseshm_create(char *name);
+void pulseshm_put(pulseshm_t *shm, unsigned short w);
+void pulseshm_flush(pulseshm_t *shm);
+
+/* consumer side */
+int pulseshm_open(pulseshm_reader_t *r, char *name);
+int pulseshm_peek(pulseshm_reader_t *r, const uint16_t **wordsp);
+int pulseshm_consume(pulseshm_reader_t *r, int n);
+int pulseshm_wait(pulseshm_reader_t *r, int timeout_ms);
+
+#endif /* PULSESHM_H */
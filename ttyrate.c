@@ -0,0 +1,48 @@
+/*
+ * ttyrate.c
+ *
+ * arbitrary tty baud rates, using the linux termios2 interface.
+ * this lives on its own because the kernel's termios2 headers
+ * can't be included alongside glibc's <termios.h>.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+int tty_set_rate(int fd, int rate);
+
+/* set both directions to 'rate' bits/sec.  returns ioctl()'s result. */
+int
+tty_set_rate(int fd, int rate)
+{
+    struct termios2 t2;
+
+    if (ioctl(fd, TCGETS2, &t2) < 0)
+        return -1;
+
+    t2.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    t2.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    t2.c_ispeed = rate;
+    t2.c_ospeed = rate;
+
+    return ioctl(fd, TCSETS2, &t2);
+}
@@ -0,0 +1,236 @@
+/*
+ * tunnel.c
+ *
+ * burst-framed TCP tunnel.  see tunnel.h for the encoding.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "avrhost.h"
+#include "tunnel.h"
+
+static unsigned short burst[TUNNEL_WORDS];
+static int nburst;
+
+static unsigned char *
+put_varint(unsigned char *p, unsigned int v)
+{
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+/* returns the number of bytes used, or 0 if 'len' is too short */
+static int
+get_varint(const unsigned char *p, int len, unsigned int *vp)
+{
+    unsigned int v = 0;
+    int i;
+
+    for (i = 0; i < len && i < 5; i++) {
+        v |= (p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *vp = v;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/* encode a burst as one frame.  returns its length. */
+static int
+tunnel_encode(unsigned char *frame, const unsigned short *w, int n)
+{
+    unsigned char payload[TUNNEL_MAXFRAME], *p = payload, *f;
+    int i, t, d, prev[2] = {0, 0}, pulse;
+
+    *p++ = TUNNEL_BURST;
+    for (i = 0; i < n; i++) {
+        pulse = !!(w[i] & 0x8000);
+        t = w[i] & 0x7fff;
+        d = t - prev[pulse];
+        prev[pulse] = t;
+        p = put_varint(p, ((d < 0 ? -2 * d - 1 : 2 * d) << 1) | pulse);
+    }
+
+    f = put_varint(frame, p - payload);
+    memcpy(f, payload, p - payload);
+    return f - frame + (p - payload);
+}
+
+/* decode one frame's payload.  returns the word count, or -1. */
+static int
+tunnel_decode(const unsigned char *p, int len, unsigned short *w)
+{
+    unsigned int v;
+    int n = 0, k, d, pulse, prev[2] = {0, 0};
+
+    if (len < 1 || *p != TUNNEL_BURST)
+        return -1;
+    p++;
+    len--;
+
+    while (len) {
+        k = get_varint(p, len, &v);
+        if (!k || n == TUNNEL_WORDS)
+            return -1;
+        p += k;
+        len -= k;
+
+        pulse = v & 1;
+        v >>= 1;
+        d = (v & 1) ? -(int)((v + 1) / 2) : (int)(v / 2);
+        prev[pulse] += d;
+        w[n++] = (prev[pulse] & 0x7fff) | (pulse ? 0x8000 : 0);
+    }
+    return n;
+}
+
+int
+tunnel_pending(void)
+{
+    return nburst;
+}
+
+/* send whatever burst we've collected as one frame */
+void
+tunnel_flush(dest_t *d)
+{
+    unsigned char frame[TUNNEL_MAXFRAME + 5];
+    int len;
+
+    if (!nburst)
+        return;
+
+    len = tunnel_encode(frame, burst, nburst);
+    nburst = 0;
+
+    if (dest_send(d, frame, len) < 0 && errno != ECONNREFUSED)
+        report("tunnel write failed, reconnecting");
+}
+
+/*
+ * queue a word.  a long space starts a new burst, so anything
+ * before it is sent now.  otherwise the caller flushes after
+ * TUNNEL_IDLE_MS of silence.
+ */
+void
+tunnel_word(dest_t *d, unsigned short w)
+{
+    if ((!(w & 0x8000) && (w & 0x7fff) >= TUNNEL_GAP_TICKS) ||
+            nburst == TUNNEL_WORDS)
+        tunnel_flush(d);
+    burst[nburst++] = w;
+}
+
+
+/*
+ * the far end:  accept a tunnel connection, and turn each frame back
+ * into a UDP datagram for lircd.  one connection at a time.
+ */
+static void
+tunnel_serve(int s, dest_t *to)
+{
+    unsigned char buf[2 * TUNNEL_MAXFRAME], out[2 * TUNNEL_WORDS];
+    unsigned short w[TUNNEL_WORDS];
+    unsigned int plen;
+    int len = 0, n, k, i;
+
+    while (1) {
+        n = read(s, buf + len, sizeof(buf) - len);
+        if (n <= 0)
+            return;
+        len += n;
+
+        while (len) {
+            k = get_varint(buf, len, &plen);
+            if (!k) {
+                if (len >= 5)
+                    goto bad;
+                break;
+            }
+            if (plen > TUNNEL_MAXFRAME)
+                goto bad;
+            if (k + plen > len)
+                break;          /* wait for the rest */
+
+            n = tunnel_decode(buf + k, plen, w);
+            if (n < 0)
+                goto bad;
+
+            for (i = 0; i < n; i++) {
+                out[2 * i] = w[i] & 0xff;
+                out[2 * i + 1] = w[i] >> 8;
+            }
+            if (n && dest_send(to, out, 2 * n) < 0 && errno != ECONNREFUSED)
+                report("write failed (%s), reconnecting", strerror(errno));
+
+            len -= k + plen;
+            memmove(buf, buf + k + plen, len);
+        }
+    }
+
+ bad:
+    report("garbled tunnel frame, dropping connection");
+}
+
+void
+tunnel_receive(int port, dest_t *to)
+{
+    struct sockaddr_in sin;
+    int ls, s, one = 1;
+
+    if ((ls = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        die("stream socket open");
+    setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(ls, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+        die("bind to port %d", port);
+    if (listen(ls, 1) < 0)
+        die("listen");
+
+    while (1) {
+        s = accept(ls, 0, 0);
+        if (s < 0) {
+            if (errno == EINTR)
+                continue;
+            die("accept");
+        }
+        report("tunnel connected");
+        tunnel_serve(s, to);
+        close(s);
+        report("tunnel disconnected");
+    }
+}
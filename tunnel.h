@@ -0,0 +1,56 @@
+/*
+ * tunnel.h
+ *
+ * a compact, burst-framed encoding of the avrlirc word stream, for
+ * carrying it over TCP (through an ssh tunnel, say) to a far-end
+ * avrlirc2udp, which turns each burst back into one UDP datagram
+ * for lircd.
+ *
+ * each frame is a varint payload length, followed by the payload:
+ * a type byte (TUNNEL_BURST), then one varint per word.  the varint
+ * holds the word's duration as a zigzag-coded difference from the
+ * previous duration of the same kind (pulse or space) in the frame,
+ * shifted up by one, with the pulse flag in the low bit.  IR
+ * protocols reuse a handful of widths, so most words cost one byte
+ * rather than two.
+ *
+ **********
+ *
+ * Copyright (C) 2007, 2009, Paul G. Fox
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef TUNNEL_H
+#define TUNNEL_H
+
+#include "avrhost.h"
+
+#define TUNNEL_BURST 1          /* frame type */
+#define TUNNEL_WORDS 512        /* most words in a frame */
+#define TUNNEL_MAXFRAME (3 + 1 + TUNNEL_WORDS * 3)
+#define TUNNEL_IDLE_MS 20       /* this much silence ends a burst... */
+#define TUNNEL_GAP_TICKS 164    /* ...as does a 10ms space */
+
+/* sending side */
+void tunnel_word(dest_t *d, unsigned short w);
+int tunnel_pending(void);
+void tunnel_flush(dest_t *d);
+
+/* receiving side:  never returns */
+void tunnel_receive(int port, dest_t *to);
+
+#endif /* TUNNEL_H */